@@ -3,9 +3,13 @@
 //
 
 #include "core/system.h"
+#include "telemetry.h"
 #include "timer.h"
+#include "version.h"
+#include <core/boot-handoff.h>
+#include <core/event-loop.h>
 #include <core/logger.h>
-#include <core/simple-timer.h>
+#include <core/timer-wheel.h>
 #include <core/uart.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scb.h>
@@ -19,6 +23,17 @@
 #define LED_RED_PIN  (GPIO14)
 #define LED_BLUE_PIN (GPIO7)
 
+// 64 steps of 100 PWM periods (~3.3 kHz), ~2 s per waveform
+#define LED_WAVE_LEN		64
+#define LED_PERIODS_PER_STEP	100
+#define LED_WAVE_SWITCH_MS	10000
+
+static struct timer_wheel	s_timer_wheel;
+static struct timer_wheel_timer s_led_timer;
+
+static pwm_duty_t s_led_breathe[LED_WAVE_LEN];
+static pwm_duty_t s_led_heartbeat[LED_WAVE_LEN];
+
 static void vector_setup(void)
 {
 	SCB_VTOR = 0x08000000U + BOOTLOADER_SIZE;
@@ -27,29 +42,90 @@ static void vector_setup(void)
 static void gpio_setup(void)
 {
 	rcc_periph_clock_enable(RCC_GPIOB);
-	// gpio_mode_setup(LED_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE, LED_RED_PIN);
-	// gpio_set_af(LED_PORT, GPIO_AF9, LED_RED_PIN);
+	// TIM8_CH2N
+	gpio_mode_setup(LED_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE, LED_RED_PIN);
+	gpio_set_af(LED_PORT, GPIO_AF3, LED_RED_PIN);
+}
 
-	gpio_mode_setup(LED_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, LED_RED_PIN);
+static void led_waves_setup(void)
+{
+	for (uint32_t i = 0; i < LED_WAVE_LEN; ++i) {
+		// squared triangle, brightness is perceived roughly as the square root of duty
+		const uint32_t half = LED_WAVE_LEN / 2;
+		const uint32_t tri  = i < half ? i : LED_WAVE_LEN - 1 - i;
+
+		s_led_breathe[i] = (pwm_duty_t)(tri * tri * 0xFFFFU / ((half - 1) * (half - 1)));
+	}
+
+	for (uint32_t i = 0; i < LED_WAVE_LEN; ++i) {
+		s_led_heartbeat[i] = 0;
+	}
+	for (uint32_t i = 0; i < 4; ++i) {
+		s_led_heartbeat[i]     = PWM_DUTY_PERCENT(100);
+		s_led_heartbeat[i + 8] = PWM_DUTY_PERCENT(40);
+	}
+}
+
+// the swap happens when the playing waveform ends, the CPU is not involved in between
+static void led_next_wave(struct timer_wheel_timer *timer, void *ctx)
+{
+	(void)timer;
+	(void)ctx;
+	static bool heartbeat = false;
+
+	heartbeat = !heartbeat;
+	pwm_seq_queue(heartbeat ? s_led_heartbeat : s_led_breathe, LED_WAVE_LEN);
+}
+
+static void report_boot(const struct boot_handoff *handoff, uint32_t main_cycles)
+{
+	// the cycle counter keeps running across the jump, only the handoff path is timed
+	const uint32_t handoff_us = (main_cycles - handoff->handoff_cycles) / CYCLES_PER_US;
+
+	printf("Reset reason: %s\n", boot_handoff_reset_reason_str(handoff->reset_flags));
+	printf("Bootloader: %s (%lu bytes), ran %lu ms, handoff to main %lu us\n",
+	       boot_update_result_str(handoff->update_result), handoff->fw_length,
+	       (uint32_t)handoff->handoff_ticks, handoff_us);
 }
 
 int main(void)
 {
+	const uint32_t main_cycles = system_get_cycles();
+
+	struct boot_handoff handoff	= {0};
+	const bool	    handed_over = boot_handoff_take(&handoff);
+
 	vector_setup();
-	system_setup();
+	if (handed_over) {
+		system_resume(&handoff);
+	} else {
+		system_setup();
+	}
 	gpio_setup();
 	timer_setup();
 	stdout = create_logger();
 
-	printf("Hello, from main app!\n");
+	printf("Hello, from main app v%lu.%lu.%lu!\n", image_header.fw_version >> 16,
+	       (image_header.fw_version >> 8) & 0xff, image_header.fw_version & 0xff);
+	if (handed_over) {
+		report_boot(&handoff, main_cycles);
+	} else {
+		printf("No bootloader handoff, clocks set up from scratch\n");
+	}
+
+	led_waves_setup();
+	pwm_seq_start(s_led_breathe, LED_WAVE_LEN, LED_PERIODS_PER_STEP, pwm_seq_mode_loop);
+
+	timer_wheel_setup(&s_timer_wheel, system_get_ticks());
+	timer_wheel_timer_setup(&s_led_timer, led_next_wave, NULL);
+	timer_wheel_arm(&s_timer_wheel, &s_led_timer, LED_WAVE_SWITCH_MS, LED_WAVE_SWITCH_MS);
+
+	telemetry_setup(&s_timer_wheel);
 
-	struct simple_timer timer = {0};
-	simple_timer_setup(&timer, 1000, true);
+	event_loop_setup(&s_timer_wheel);
 
 	while (1) {
-		if (simple_timer_has_elapsed(&timer)) {
-			gpio_toggle(LED_PORT, LED_RED_PIN);
-		}
+		event_loop_run_once();
 	}
 
 	// Never return
@@ -0,0 +1,79 @@
+#include "telemetry.h"
+#include "timer.h"
+#include <core/comms.h>
+#include <core/system.h>
+#include <core/uart-dma-tx.h>
+#include <core/uart.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/usart.h>
+#include <stddef.h>
+
+#define TELEMETRY_PERIOD_MS 1
+#define TELEMETRY_CHANNELS  27
+
+// 64 byte payload, 73 bytes on the wire per frame, ~80% of the line at 921600 Bd
+struct telemetry_sample {
+	uint32_t sample_idx;
+	uint32_t timestamp_us;
+	uint16_t led_duty;
+	int16_t	 channels[TELEMETRY_CHANNELS];
+};
+
+static struct uart_driver s_telemetry_uart = {
+    .usart_dev	     = USART3,
+    .usart_clock_dev = RCC_USART3,
+    .nvic_irq	     = NVIC_USART3_IRQ,
+    .gpio_pins	     = GPIO8,
+    .gpio_port	     = GPIOD,
+    .gpio_port_clk   = RCC_GPIOD,
+    .gpio_af	     = GPIO_AF7,
+    .baud_rate	     = TELEMETRY_BAUD,
+    .mode	     = USART_MODE_TX,
+};
+
+// USART3_TX is DMA1 stream 3 channel 4
+static struct uart_dma_tx s_telemetry_tx = {
+    .uart     = &s_telemetry_uart,
+    .dma      = DMA1,
+    .stream   = DMA_STREAM3,
+    .channel  = DMA_SxCR_CHSEL_4,
+    .nvic_irq = NVIC_DMA1_STREAM3_IRQ,
+};
+
+static struct comms		s_telemetry_comms;
+static struct timer_wheel_timer s_telemetry_timer;
+static struct telemetry_sample	s_sample;
+
+void dma1_stream3_isr(void)
+{
+	uart_dma_tx_handle_irq(&s_telemetry_tx);
+}
+
+static void telemetry_sample(struct timer_wheel_timer *timer, void *ctx)
+{
+	(void)timer;
+	(void)ctx;
+
+	s_sample.timestamp_us = (uint32_t)system_get_us();
+	s_sample.led_duty     = timer_pwm_get_duty();
+	for (uint32_t i = 0; i < TELEMETRY_CHANNELS; ++i) {
+		// stand-in for real sensors, ramps of different slopes
+		s_sample.channels[i] = (int16_t)(s_sample.sample_idx * (i + 1));
+	}
+
+	// a full buffer skips this sample, the control loop never waits for the line
+	comms_stream_send(&s_telemetry_comms, (const uint8_t *)&s_sample, sizeof(s_sample));
+	s_sample.sample_idx++;
+}
+
+void telemetry_setup(struct timer_wheel *tw)
+{
+	uart_setup(&s_telemetry_uart);
+	uart_dma_tx_setup(&s_telemetry_tx);
+	comms_setup(&s_telemetry_comms, uart_dma_tx_transport(&s_telemetry_tx));
+	comms_set_framing(&s_telemetry_comms, comms_framing_cobs);
+
+	timer_wheel_timer_setup(&s_telemetry_timer, telemetry_sample, NULL);
+	timer_wheel_arm(tw, &s_telemetry_timer, TELEMETRY_PERIOD_MS, TELEMETRY_PERIOD_MS);
+}
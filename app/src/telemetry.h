@@ -0,0 +1,11 @@
+#ifndef INC_TELEMETRY_H
+#define INC_TELEMETRY_H
+
+#include <core/timer-wheel.h>
+
+// streams a sample frame every millisecond on USART3 (ST-LINK VCP), see fw-updated/telemetry.py
+#define TELEMETRY_BAUD 921600
+
+void telemetry_setup(struct timer_wheel *tw);
+
+#endif /* INC_TELEMETRY_H */
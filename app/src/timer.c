@@ -1,25 +1,178 @@
 #include "timer.h"
-#include <libopencm3/stm32/timer.h>
+#include <core/cache.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// TIM12 has no DMA request on the F7, TIM8 drives the same pin (PB14) through CH2N
+// and its update event is served by DMA2 stream 1 channel 7
+#define TIMER	   TIM8
+#define DMA	   DMA2
+#define DMA_STREAM DMA_STREAM1
 
-#define TIMER TIM12
+// 216 MHz / 65536 = ~3.3 kHz PWM
+#define PRESCALER 1
+#define ARR_VALUE 0x10000
 
-#define PRESCALER 217
-#define ARR_VALUE 1000
+struct pwm_seq {
+	const pwm_duty_t *volatile pending; // queued table, not yet in both address registers
+	uint16_t	 length;
+	enum pwm_seq_mode mode;
+	volatile bool	  busy;
+};
+
+static struct pwm_seq s_seq;
 
 void timer_setup(void)
 {
-    rcc_periph_clock_enable(RCC_TIM12);
-    timer_set_mode(TIMER, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
-    timer_set_oc_mode(TIMER, TIM_OC1, TIM_OCM_PWM1);
-    timer_enable_counter(TIMER);
-    timer_enable_oc_output(TIMER, TIM_OC1);
-    timer_set_prescaler(TIMER, PRESCALER - 1);
-    timer_set_period(TIMER, ARR_VALUE - 1);
+	rcc_periph_clock_enable(RCC_TIM8);
+	rcc_periph_clock_enable(RCC_DMA2);
+
+	timer_set_mode(TIMER, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_set_prescaler(TIMER, PRESCALER - 1);
+	timer_set_period(TIMER, ARR_VALUE - 1);
+	timer_enable_preload(TIMER);
+
+	// compare is preloaded, a value written by DMA takes effect on the next period
+	timer_set_oc_mode(TIMER, TIM_OC2, TIM_OCM_PWM1);
+	timer_enable_oc_preload(TIMER, TIM_OC2);
+	// with CC2E off CH2N follows OC2REF, active high keeps the duty the LED on-time
+	timer_set_oc_polarity_high(TIMER, TIM_OC2N);
+	timer_enable_oc_output(TIMER, TIM_OC2N);
+	timer_enable_break_main_output(TIMER);
+
+	nvic_enable_irq(NVIC_DMA2_STREAM1_IRQ);
+	timer_enable_counter(TIMER);
 }
 
-void timer_pwm_set_duty_cycle(float duty_cycle)
+void timer_pwm_set_duty(pwm_duty_t duty)
 {
-    const float raw_value = (float)ARR_VALUE * (duty_cycle / 100.0f);
-    timer_set_oc_value(TIMER, TIM_OC1, (uint32_t)raw_value);
+	timer_set_oc_value(TIMER, TIM_OC2, duty);
+}
+
+pwm_duty_t timer_pwm_get_duty(void)
+{
+	return TIM_CCR2(TIMER);
+}
+
+static void pwm_seq_flush(const pwm_duty_t *table, uint16_t length)
+{
+	// DMA reads memory, not the D-cache
+	cache_clean_dcache(table, length * sizeof(pwm_duty_t));
+}
+
+bool pwm_seq_start(const pwm_duty_t *table, uint16_t length, uint16_t periods_per_step,
+		   enum pwm_seq_mode mode)
+{
+	if (periods_per_step < 1 || periods_per_step > 256) {
+		return false;
+	}
+
+	pwm_seq_stop();
+	pwm_seq_flush(table, length);
+
+	s_seq.pending = NULL;
+	s_seq.length  = length;
+	s_seq.mode    = mode;
+	s_seq.busy    = true;
+
+	dma_stream_reset(DMA, DMA_STREAM);
+	dma_channel_select(DMA, DMA_STREAM, DMA_SxCR_CHSEL_7);
+	dma_set_transfer_mode(DMA, DMA_STREAM, DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+	dma_set_priority(DMA, DMA_STREAM, DMA_SxCR_PL_HIGH);
+	dma_set_memory_size(DMA, DMA_STREAM, DMA_SxCR_MSIZE_16BIT);
+	dma_set_peripheral_size(DMA, DMA_STREAM, DMA_SxCR_PSIZE_16BIT);
+	dma_enable_memory_increment_mode(DMA, DMA_STREAM);
+	dma_set_peripheral_address(DMA, DMA_STREAM, (uint32_t)(uintptr_t)&TIM_CCR2(TIMER));
+	dma_set_memory_address(DMA, DMA_STREAM, (uint32_t)(uintptr_t)table);
+	dma_set_number_of_data(DMA, DMA_STREAM, length);
+
+	if (mode == pwm_seq_mode_loop) {
+		// both targets play the same table until pwm_seq_queue points one elsewhere
+		dma_set_memory_address_1(DMA, DMA_STREAM, (uint32_t)(uintptr_t)table);
+		dma_enable_double_buffer_mode(DMA, DMA_STREAM);
+		dma_enable_circular_mode(DMA, DMA_STREAM);
+	}
+	dma_enable_transfer_complete_interrupt(DMA, DMA_STREAM);
+	dma_enable_stream(DMA, DMA_STREAM);
+
+	timer_set_repetition_counter(TIMER, periods_per_step - 1);
+	timer_generate_event(TIMER, TIM_EGR_UG);
+	timer_enable_irq(TIMER, TIM_DIER_UDE);
+
+	return true;
+}
+
+bool pwm_seq_queue(const pwm_duty_t *table, uint16_t length)
+{
+	if (!s_seq.busy || s_seq.mode != pwm_seq_mode_loop || length != s_seq.length) {
+		return false;
+	}
+
+	pwm_seq_flush(table, length);
+
+	// only the target not being played may be written, the other one follows in the ISR,
+	// a TC in between toggles CT and libopencm3 silently refuses the write, so it is
+	// repeated until CT is the same after the write as before
+	nvic_disable_irq(NVIC_DMA2_STREAM1_IRQ);
+	s_seq.pending = table;
+
+	bool on_m1 = false;
+	do {
+		on_m1 = DMA_SCR(DMA, DMA_STREAM) & DMA_SxCR_CT;
+		if (on_m1) {
+			dma_set_memory_address(DMA, DMA_STREAM, (uint32_t)(uintptr_t)table);
+		} else {
+			dma_set_memory_address_1(DMA, DMA_STREAM, (uint32_t)(uintptr_t)table);
+		}
+	} while (on_m1 != ((DMA_SCR(DMA, DMA_STREAM) & DMA_SxCR_CT) != 0));
+	nvic_enable_irq(NVIC_DMA2_STREAM1_IRQ);
+
+	return true;
+}
+
+void pwm_seq_stop(void)
+{
+	timer_disable_irq(TIMER, TIM_DIER_UDE);
+	dma_disable_stream(DMA, DMA_STREAM);
+	dma_clear_interrupt_flags(DMA, DMA_STREAM, DMA_TCIF | DMA_TEIF);
+	s_seq.busy = false;
+}
+
+bool pwm_seq_busy(void)
+{
+	return s_seq.busy;
+}
+
+// once per table, so the CPU is not involved in the individual steps
+void dma2_stream1_isr(void)
+{
+	if (!dma_get_interrupt_flag(DMA, DMA_STREAM, DMA_TCIF)) {
+		return;
+	}
+	dma_clear_interrupt_flags(DMA, DMA_STREAM, DMA_TCIF);
+
+	if (s_seq.mode == pwm_seq_mode_one_shot) {
+		// the stream stopped itself, the compare register keeps the last value
+		timer_disable_irq(TIMER, TIM_DIER_UDE);
+		s_seq.busy = false;
+		return;
+	}
+
+	const uint32_t pending = (uint32_t)(uintptr_t)s_seq.pending;
+	const bool     on_m1   = DMA_SCR(DMA, DMA_STREAM) & DMA_SxCR_CT;
+	const uint32_t playing = on_m1 ? DMA_SM1AR(DMA, DMA_STREAM) : DMA_SM0AR(DMA, DMA_STREAM);
+
+	// once the queued table is playing, the target just released loops it too
+	if (pending && playing == pending) {
+		if (on_m1) {
+			dma_set_memory_address(DMA, DMA_STREAM, pending);
+		} else {
+			dma_set_memory_address_1(DMA, DMA_STREAM, pending);
+		}
+		s_seq.pending = NULL;
+	}
 }
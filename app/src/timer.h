@@ -1,7 +1,31 @@
 #ifndef INC_CORE_TIMER_H
 #define INC_CORE_TIMER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// fraction of the PWM period in Q0.16, the timer counts the full 16 bits
+// so a duty value is the compare value as is, 0xFFFF is the closest to 100%
+typedef uint16_t pwm_duty_t;
+#define PWM_DUTY_PERCENT(percent) ((pwm_duty_t)(((percent) * 0xFFFFU) / 100U))
+
+enum pwm_seq_mode {
+	pwm_seq_mode_one_shot, // plays the table once, then holds its last value
+	pwm_seq_mode_loop,
+};
+
 void timer_setup(void);
-void timer_pwm_set_duty_cycle(float duty_cycle);
+void	   timer_pwm_set_duty(pwm_duty_t duty);
+pwm_duty_t timer_pwm_get_duty(void);
+
+// streams table into the compare register by DMA, one entry every periods_per_step
+// PWM periods (1..256), the table must stay valid while it is played, false and nothing
+// started if periods_per_step is out of range
+bool pwm_seq_start(const pwm_duty_t *table, uint16_t length, uint16_t periods_per_step,
+		   enum pwm_seq_mode mode);
+// loop mode only, table takes over once the current one ends, false if the length differs
+bool pwm_seq_queue(const pwm_duty_t *table, uint16_t length);
+void pwm_seq_stop(void);
+bool pwm_seq_busy(void);
 
-#endif /* INC_CORE_TIMER_H */
+#endif
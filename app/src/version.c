@@ -0,0 +1,12 @@
+#include "version.h"
+#include "core/system.h"
+#include <libopencm3/stm32/memorymap.h>
+
+// size and digests are zero here, app/stamp-image.py fills them into app.bin
+__attribute__((section(".image_header"), used)) const struct image_header image_header = {
+    .magic	    = IMAGE_HEADER_MAGIC,
+    .header_version = IMAGE_HEADER_VERSION,
+    .header_size    = sizeof(struct image_header),
+    .fw_version	    = IMAGE_FW_VERSION(FW_VERSION_MAJOR, FW_VERSION_MINOR, FW_VERSION_PATCH),
+    .load_address   = FLASH_BASE + BOOTLOADER_SIZE,
+};
@@ -0,0 +1,8 @@
+#ifndef INC_VERSION_H
+#define INC_VERSION_H
+
+#include "core/image-header.h"
+
+extern const struct image_header image_header;
+
+#endif /* INC_VERSION_H */
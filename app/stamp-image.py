@@ -0,0 +1,46 @@
+import struct
+import sys
+import zlib
+
+IMAGE_HEADER_OFFSET = 0x400
+IMAGE_HEADER_MAGIC = 0x31474D49
+
+# struct image_header, see shared/inc/core/image-header.h
+image_header_format = "<I H H I I I I I"
+image_header_len = struct.calcsize(image_header_format)
+
+if len(sys.argv) != 3:
+    raise Exception("usage: stamp-image.py <app.bin> <bootloader size>")
+
+APP_FILE = sys.argv[1]
+# from core/system.h, passed in by the Makefile
+BOOTLOADER_SIZE = int(sys.argv[2], 0)
+
+with open(APP_FILE, "rb") as f:
+    raw_file = bytearray(f.read())
+
+app = raw_file[BOOTLOADER_SIZE:]
+header_end = IMAGE_HEADER_OFFSET + image_header_len
+
+(magic, header_version, header_size, fw_version, load_address, _, _, _) = struct.unpack_from(
+    image_header_format, app, IMAGE_HEADER_OFFSET)
+
+if magic != IMAGE_HEADER_MAGIC or header_size != image_header_len:
+    raise Exception("no image header at offset 0x{:X}".format(IMAGE_HEADER_OFFSET))
+
+image_size = len(app)
+image_crc32 = zlib.crc32(app[header_end:], zlib.crc32(app[:IMAGE_HEADER_OFFSET]))
+
+header = struct.pack(image_header_format[:-2], magic, header_version, header_size,
+                     fw_version, load_address, image_size, image_crc32)
+header_crc32 = zlib.crc32(header)
+
+struct.pack_into(image_header_format, app, IMAGE_HEADER_OFFSET, magic, header_version,
+                 header_size, fw_version, load_address, image_size, image_crc32, header_crc32)
+
+print("stamped image v{}.{}.{} of {} bytes at 0x{:08X}, crc32 0x{:08X}".format(
+      fw_version >> 16, (fw_version >> 8) & 0xff, fw_version & 0xff, image_size, load_address,
+      image_crc32))
+
+with open(APP_FILE, "wb") as f:
+    f.write(raw_file[:BOOTLOADER_SIZE] + app)
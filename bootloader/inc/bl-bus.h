@@ -0,0 +1,25 @@
+#ifndef INC_BL_BUS_H
+#define INC_BL_BUS_H
+
+#include <core/comms.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// multicast update on a shared bus, the image is broadcast once as stream frames of one
+// block each, seq is the block index, every node programs what it got and reports the gaps,
+// which the host then repairs node by node with unicast frames
+#define BL_BUS_BLOCK_LEN     COMMS_STREAM_PAYLOAD_LEN
+#define BL_BUS_STATUS_BLOCKS 64 // blocks covered by one block_status_res
+// sized for the whole flash, the app region is smaller
+#define BL_BUS_MAX_BLOCKS ((2 * 1024 * 1024) / BL_BUS_BLOCK_LEN)
+
+// flash_address must be word aligned and erased
+void bl_bus_setup(uint32_t flash_address, uint32_t length);
+// programs the block unless it is out of range, of the wrong size or already there
+bool	 bl_bus_take_block(uint32_t index, const uint8_t *data, uint32_t len);
+uint32_t bl_bus_missing(void);
+// first missing block at or after start, the block count if there is none,
+// bitmap gets the missing bits of BL_BUS_STATUS_BLOCKS blocks from there, LSB first
+uint32_t bl_bus_status(uint32_t start, uint8_t *bitmap);
+
+#endif /* INC_BL_BUS_H */
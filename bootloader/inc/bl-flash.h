@@ -5,9 +5,29 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+// dual bank (nDBANK cleared) the running bootloader and app stay in the bank mapped at
+// FLASH_BASE, updates are erased and programmed in the other one while code keeps running
+// from this one, bl_flash_commit then swaps the banks, single bank both are the same place
+
+// erases the sectors an update is programmed to
 void bl_flash_erase_main_app(void);
+// dual bank, the same without waiting, starts erasing the inactive bank one sector at a
+// time, each bl_flash_erase_step starts the next once the flash is idle
+void bl_flash_erase_start(void);
+// true once every update sector is erased, the flash is locked again then
+bool bl_flash_erase_step(void);
 void bl_flash_write(const uint32_t address, const uint8_t * data, size_t len);
+// x32 parallelism, 4x fewer program operations than bl_flash_write, address word aligned
+void bl_flash_program_words(uint32_t address, const uint32_t *words, uint32_t count);
 bool bl_flash_is_dual_bank(void);
 uint32_t bl_flash_get_main_app_available_size(void);
+// where an update is programmed, the app address of the inactive bank dual bank
+uint32_t bl_flash_get_update_address(void);
+// dual bank, maps the bank with the newest commit record at FLASH_BASE, first thing at boot,
+// before the caches are on, stays on bank 1 if the other bootloader copy differs
+void bl_flash_select_bank(void);
+// dual bank, copies the bootloader over if the other bank lacks it, writes the commit record
+// and swaps, the update becomes the app at FLASH_BASE, false leaves the banks as they were
+bool bl_flash_commit(void);
 
 #endif /* INC_BL_FLASH_H */
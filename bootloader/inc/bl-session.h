@@ -0,0 +1,86 @@
+#ifndef INC_BL_SESSION_H
+#define INC_BL_SESSION_H
+
+#include <core/boot-handoff.h>
+#include <core/comms.h>
+#include <core/rtt.h>
+#include <core/timer-wheel.h>
+#include <core/transport.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// firmware update protocol of one port, several sessions may listen at once, the first
+// to see the sync sequence owns the update and the others stay quiet from then on,
+// the flash staging and the bus block map are shared, only the owner touches them
+
+enum bl_session_step {
+	bl_session_step_sync,
+	bl_session_step_wait_for_update_req,
+	bl_session_step_device_id_req,
+	bl_session_step_device_id_res,
+	bl_session_step_firmware_length_req,
+	bl_session_step_firmware_length_res,
+	bl_session_step_erase_app,
+	bl_session_step_erase_wait, // dual bank, the sector erases run while the loop does
+	bl_session_step_receive_firmware,
+	bl_session_step_flush_staged,
+	bl_session_step_bus_receive,
+	bl_session_step_done,
+	bl_session_step_finished, // the done callback ran, steps do nothing
+};
+
+struct bl_session;
+
+// the update is over, the bootloader boots the app from here, fw_length is what arrived
+typedef void (*bl_session_done_t)(struct bl_session *session, enum boot_update_result result,
+				  uint32_t fw_length);
+
+struct bl_session_config {
+	const char	   *name; // in the log
+	struct transport   *transport;
+	struct timer_wheel *timer_wheel; // for the sync and idle timeouts
+	uint32_t	    app_address;    // the installed image, checked and read back
+	uint32_t	    update_address; // erased and programmed through bl-flash
+	uint8_t		    bus_address; // answered to after the bus sync sequence
+	// sent in device_id_req, tells apart nodes that answer to one bus address
+	uint32_t	    unique_id[3];
+	// point to point sessions parse in the transport rx handler once synced, see
+	// comms_set_isr_mode, acks leave at interrupt latency whatever the main loop does
+	bool		    isr_rx;
+	bl_session_done_t   done;
+	void		   *ctx;
+};
+
+struct bl_session {
+	struct bl_session_config config;
+	struct comms		 comms;
+	enum bl_session_step	 step;
+	uint8_t			 sync_seq[4];
+	uint32_t		 fw_length;
+	uint32_t		 fw_length_received;
+	bool			 ready_pending; // the host gets its ready once staging has room
+	bool			 more;		// step again without waiting for input
+	uint64_t		 receive_start_us;
+	uint32_t		 read_address; // next block of an ongoing readback
+	uint32_t		 read_end;
+	uint32_t		 read_credits; // blocks the host is ready to take
+	bool			 request_pending; // sent a request, its reply is an RTT sample
+	uint64_t		 request_tick;
+	uint64_t		 request_retx_cnt; // a retx since voids the sample
+	// round trips of requests to the host, in ticks, the idle timeouts follow it
+	struct rtt_estimator	 rtt;
+	struct timer_wheel_timer timeout_timer;
+};
+
+// the sync timeout starts here, the config is copied
+void bl_session_setup(struct bl_session *session, const struct bl_session_config *config);
+// handles what the port received so far, never waits for input, blocks only while
+// programming or erasing a single bank flash, true if it wants to run again before more
+// input arrives
+bool bl_session_step(struct bl_session *session);
+// the session that saw the sync sequence first, NULL before
+struct bl_session *bl_session_owner(void);
+
+const char *bl_session_step_str(enum bl_session_step step);
+
+#endif /* INC_BL_SESSION_H */
@@ -0,0 +1,33 @@
+#ifndef INC_BL_STAGE_H
+#define INC_BL_STAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// RAM staging between the link and flash, received data is stored at link speed
+// and programmed in word aligned bursts while the host already sends the next packets
+#define BL_STAGE_SIZE	   (64 * 1024)
+#define BL_STAGE_BURST_LEN (256)
+
+struct bl_stage_stats {
+	uint32_t staged;     // bytes taken from the link
+	uint32_t programmed; // bytes written to flash
+	uint32_t bursts;
+	uint32_t program_us; // time spent programming
+	uint32_t max_fill;   // staging high watermark
+};
+
+// flash_address must be word aligned and erased
+void	 bl_stage_setup(uint32_t flash_address);
+uint32_t bl_stage_space(void);
+uint32_t bl_stage_pending(void);
+// false if data does not fit, check bl_stage_space first
+bool bl_stage_push(const uint8_t *data, uint32_t len);
+
+// programs up to one burst of whole words, a partial last word only with flush,
+// padded with the erased value, returns the number of bytes programmed
+uint32_t bl_stage_program_burst(bool flush);
+
+const struct bl_stage_stats *bl_stage_get_stats(void);
+
+#endif /* INC_BL_STAGE_H */
@@ -0,0 +1,8 @@
+#ifndef INC_CACHE_BENCH_H
+#define INC_CACHE_BENCH_H
+
+// measures crc8 and comms_update with L1 caches off and on, prints the cycle counts
+// built only with `make CACHE_BENCH=1`
+void cache_bench_run(void);
+
+#endif /* INC_CACHE_BENCH_H */
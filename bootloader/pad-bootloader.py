@@ -1,11 +1,14 @@
-BOOTLOADER_SIZE = 0x10000
+import sys
+
+# from core/system.h, passed in by the Makefile
+BOOTLOADER_SIZE = int(sys.argv[1], 0)
 BOOOTLOADER_FILE = "bootloader.bin"
 
 with open(BOOOTLOADER_FILE, "rb") as f:
     raw_file = f.read()
 
 if len(raw_file) > BOOTLOADER_SIZE:
-    raise "bootloader binary is too large, can't pad"
+    raise Exception("bootloader binary is too large, can't pad")
 
 bytes_to_pad = BOOTLOADER_SIZE - len(raw_file)
 print("padding bootloader of original size {} to {}".format(
@@ -0,0 +1,75 @@
+#include "bl-bus.h"
+#include "bl-flash.h"
+#include <core/cache.h>
+#include <string.h>
+
+static uint32_t s_received[(BL_BUS_MAX_BLOCKS + 31) / 32];
+static uint32_t s_flash_address;
+static uint32_t s_length;
+static uint32_t s_block_cnt;
+static uint32_t s_missing;
+
+static bool block_received(uint32_t index)
+{
+	return s_received[index / 32] & (1U << (index % 32));
+}
+
+void bl_bus_setup(uint32_t flash_address, uint32_t length)
+{
+	s_flash_address = flash_address;
+	s_length	= length;
+	s_block_cnt	= (length + BL_BUS_BLOCK_LEN - 1) / BL_BUS_BLOCK_LEN;
+	s_missing	= s_block_cnt;
+	memset(s_received, 0, sizeof(s_received));
+}
+
+bool bl_bus_take_block(uint32_t index, const uint8_t *data, uint32_t len)
+{
+	if (index >= s_block_cnt || block_received(index)) {
+		return false;
+	}
+
+	const uint32_t offset	= index * BL_BUS_BLOCK_LEN;
+	const uint32_t expected = s_length - offset < BL_BUS_BLOCK_LEN ? s_length - offset
+								       : BL_BUS_BLOCK_LEN;
+	if (len != expected) {
+		return false;
+	}
+
+	// blocks come in any order, each one is programmed on its own, the tail padded
+	uint32_t words[BL_BUS_BLOCK_LEN / sizeof(uint32_t)];
+	memset(words, 0xff, sizeof(words));
+	memcpy(words, data, len);
+
+	const uint32_t address	= s_flash_address + offset;
+	const uint32_t word_cnt = (len + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+	bl_flash_program_words(address, words, word_cnt);
+	cache_invalidate_dcache((void *)(uintptr_t)address, word_cnt * sizeof(uint32_t));
+
+	s_received[index / 32] |= 1U << (index % 32);
+	s_missing--;
+
+	return true;
+}
+
+uint32_t bl_bus_missing(void)
+{
+	return s_missing;
+}
+
+uint32_t bl_bus_status(uint32_t start, uint8_t *bitmap)
+{
+	uint32_t first = start;
+	while (first < s_block_cnt && block_received(first)) {
+		first++;
+	}
+
+	memset(bitmap, 0, BL_BUS_STATUS_BLOCKS / 8);
+	for (uint32_t i = 0; i < BL_BUS_STATUS_BLOCKS && first + i < s_block_cnt; ++i) {
+		if (!block_received(first + i)) {
+			bitmap[i / 8] |= 1U << (i % 8);
+		}
+	}
+
+	return first;
+}
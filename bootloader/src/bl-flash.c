@@ -1,36 +1,224 @@
 #include "bl-flash.h"
+#include <core/cache.h>
+#include <core/crc32.h>
+#include <core/system.h>
 #include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/syscfg.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef SYSCFG_MEMRMP_SWP_FB
+#define SYSCFG_MEMRMP_SWP_FB (1 << 8)
+#endif
+
+#define SECTOR_CNT (12)
+// dual bank, SNB[4] selects the second bank, numbering follows the physical banks
+#define BANK2_SNB (0x10)
+#define BANK_SIZE (1024 * 1024)
+
+// the bootloader takes the first 32K, one sector single bank, two per bank dual bank
+static const uint16_t single_bank_sector_kb[SECTOR_CNT] = {
+    [0] = 32,  [1] = 32,  [2] = 32,  [3] = 32,	[4] = 128,  [5] = 256,
+    [6] = 256, [7] = 256, [8] = 256, [9] = 256, [10] = 256, [11] = 256,
+};
+
+static const uint16_t dual_bank_sector_kb[SECTOR_CNT] = {
+    [0] = 16,  [1] = 16,  [2] = 16,  [3] = 16,	[4] = 64,   [5] = 128,
+    [6] = 128, [7] = 128, [8] = 128, [9] = 128, [10] = 128, [11] = 128,
+};
+
+// last bytes of each bank, programmed once the image in the bank checked out,
+// the bank with the newer record is the one mapped at FLASH_BASE
+#define BANK_RECORD_MAGIC (0x4B4E4142U) // "BANK"
+
+struct bank_record {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t crc; // crc32 of the fields above
+	uint32_t reserved[5];
+};
+
+#define BANK_RECORD_OFFSET (BANK_SIZE - sizeof(struct bank_record))
+
+// next sector of a stepped erase, SECTOR_CNT once the last one is started
+static uint8_t s_erase_next = SECTOR_CNT;
 
 bool bl_flash_is_dual_bank(void)
 {
 	return !(FLASH_OPTCR & (1 << 29));
 }
 
-#define MAIN_APP_SECTOR_START (2)
-#define MAIN_APP_SECTOR_END   (11)
+static const uint16_t *sector_kb(void)
+{
+	return bl_flash_is_dual_bank() ? dual_bank_sector_kb : single_bank_sector_kb;
+}
 
-uint16_t sector_size_kb[] = {
-    [0] = 32,  [1] = 32,  [2] = 32,  [3] = 32,	[4] = 128,  [5] = 256,
-    [6] = 256, [7] = 256, [8] = 256, [9] = 256, [10] = 256, [11] = 256,
-};
+static uint8_t app_first_sector(void)
+{
+	return bl_flash_is_dual_bank() ? 2 : 1;
+}
 
-void bl_flash_erase_main_app(void)
+static bool banks_swapped(void)
+{
+	return (SYSCFG_MEMRMP & SYSCFG_MEMRMP_SWP_FB) != 0;
+}
+
+// SNB of a sector of the bank mapped after the running one
+static uint8_t inactive_snb(uint8_t sector)
+{
+	return banks_swapped() ? sector : BANK2_SNB | sector;
+}
+
+static const struct bank_record *bank_record(uint32_t bank_address)
+{
+	return (const struct bank_record *)(uintptr_t)(bank_address + BANK_RECORD_OFFSET);
+}
+
+static bool bank_record_valid(const struct bank_record *record)
+{
+	return record->magic == BANK_RECORD_MAGIC &&
+	       record->crc == crc32((const uint8_t *)record, offsetof(struct bank_record, crc));
+}
+
+static void erase_sectors(uint8_t first, uint8_t last, bool inactive)
 {
 	flash_unlock();
-	for (uint8_t sector = MAIN_APP_SECTOR_START; sector < MAIN_APP_SECTOR_END; ++sector) {
-		flash_erase_sector(sector, FLASH_CR_PROGRAM_X32);
+	for (uint8_t sector = first; sector <= last; ++sector) {
+		flash_erase_sector(inactive ? inactive_snb(sector) : sector,
+				   FLASH_CR_PROGRAM_X32);
 	}
 	flash_lock();
 }
 
+void bl_flash_erase_main_app(void)
+{
+	// dual bank this runs from the other bank, nothing stalls while the sectors erase
+	erase_sectors(app_first_sector(), SECTOR_CNT - 1, bl_flash_is_dual_bank());
+}
+
+void bl_flash_erase_start(void)
+{
+	// an aborted session may have left one running
+	flash_wait_for_last_operation();
+	flash_unlock();
+	s_erase_next = app_first_sector();
+}
+
+bool bl_flash_erase_step(void)
+{
+	if (FLASH_SR & FLASH_SR_BSY) {
+		return false;
+	}
+	FLASH_CR &= ~(FLASH_CR_SER | (FLASH_CR_SNB_MASK << FLASH_CR_SNB_SHIFT));
+	if (s_erase_next >= SECTOR_CNT) {
+		flash_lock();
+		return true;
+	}
+
+	// flash_erase_sector, minus its wait for the erase to finish
+	FLASH_CR &= ~(FLASH_CR_PROGRAM_MASK << FLASH_CR_PROGRAM_SHIFT);
+	FLASH_CR |= FLASH_CR_PROGRAM_X32 << FLASH_CR_PROGRAM_SHIFT;
+	FLASH_CR |= (uint32_t)inactive_snb(s_erase_next++) << FLASH_CR_SNB_SHIFT;
+	FLASH_CR |= FLASH_CR_SER;
+	FLASH_CR |= FLASH_CR_STRT;
+
+	return false;
+}
+
 uint32_t bl_flash_get_main_app_available_size(void)
 {
-	uint32_t sum = 0;
-	for (uint8_t sector = MAIN_APP_SECTOR_START; sector < MAIN_APP_SECTOR_END; ++sector) {
-		sum += (sector_size_kb[sector] * 1024);
+	const uint16_t *kb  = sector_kb();
+	uint32_t	sum = 0;
+
+	for (uint8_t sector = app_first_sector(); sector < SECTOR_CNT; ++sector) {
+		sum += (kb[sector] * 1024);
 	}
 
-	return sum;
+	return bl_flash_is_dual_bank() ? sum - sizeof(struct bank_record) : sum;
+}
+
+uint32_t bl_flash_get_update_address(void)
+{
+	const uint32_t bank = bl_flash_is_dual_bank() ? FLASH_BASE + BANK_SIZE : FLASH_BASE;
+
+	return bank + BOOTLOADER_SIZE;
+}
+
+void bl_flash_select_bank(void)
+{
+	if (!bl_flash_is_dual_bank()) {
+		return;
+	}
+
+	// out of reset bank 1 is at FLASH_BASE and bank 2 follows it
+	const struct bank_record *bank1 = bank_record(FLASH_BASE);
+	const struct bank_record *bank2 = bank_record(FLASH_BASE + BANK_SIZE);
+
+	if (!bank_record_valid(bank2) ||
+	    (bank_record_valid(bank1) && (int32_t)(bank2->seq - bank1->seq) <= 0)) {
+		return;
+	}
+
+	// execution continues in place from the other bank, only safe with the same bootloader
+	// there, the commit copied it but a debugger may have reflashed bank 1 since
+	if (memcmp((const void *)(uintptr_t)FLASH_BASE,
+		   (const void *)(uintptr_t)(FLASH_BASE + BANK_SIZE), BOOTLOADER_SIZE) != 0) {
+		return;
+	}
+
+	rcc_periph_clock_enable(RCC_SYSCFG);
+	SYSCFG_MEMRMP |= SYSCFG_MEMRMP_SWP_FB;
+	__asm__ volatile("dsb\n\tisb" ::: "memory");
+}
+
+bool bl_flash_commit(void)
+{
+	if (!bl_flash_is_dual_bank()) {
+		return true;
+	}
+
+	const uint32_t inactive = FLASH_BASE + BANK_SIZE;
+	const void    *running	= (const void *)(uintptr_t)FLASH_BASE;
+	void	      *copy	= (void *)(uintptr_t)inactive;
+
+	// the image boots through the bootloader of its own bank once swapped
+	if (memcmp(copy, running, BOOTLOADER_SIZE) != 0) {
+		erase_sectors(0, app_first_sector() - 1, true);
+		bl_flash_program_words(inactive, running, BOOTLOADER_SIZE / sizeof(uint32_t));
+		cache_invalidate_dcache(copy, BOOTLOADER_SIZE);
+		if (memcmp(copy, running, BOOTLOADER_SIZE) != 0) {
+			return false;
+		}
+	}
+
+	const struct bank_record *active = bank_record(FLASH_BASE);
+	struct bank_record	  record = {0};
+
+	memset(&record, 0xff, sizeof(record));
+	record.magic = BANK_RECORD_MAGIC;
+	record.seq   = bank_record_valid(active) ? active->seq + 1 : 1;
+	record.crc   = crc32((const uint8_t *)&record, offsetof(struct bank_record, crc));
+
+	// last write of the update, an update cut short before it leaves the old bank active
+	bl_flash_program_words(inactive + BANK_RECORD_OFFSET, (const uint32_t *)&record,
+			       sizeof(record) / sizeof(uint32_t));
+	cache_invalidate_dcache((void *)(uintptr_t)(inactive + BANK_RECORD_OFFSET),
+				sizeof(record));
+	if (!bank_record_valid(bank_record(inactive))) {
+		return false;
+	}
+
+	rcc_periph_clock_enable(RCC_SYSCFG);
+	SYSCFG_MEMRMP ^= SYSCFG_MEMRMP_SWP_FB;
+	__asm__ volatile("dsb\n\tisb" ::: "memory");
+	// ART lines hold code of the bank that was mapped before
+	FLASH_ACR &= ~FLASH_ACR_ARTEN;
+	FLASH_ACR |= FLASH_ACR_ARTRST;
+	FLASH_ACR &= ~FLASH_ACR_ARTRST;
+	FLASH_ACR |= FLASH_ACR_ARTEN;
+
+	return true;
 }
 
 void bl_flash_write(const uint32_t address, const uint8_t *data, size_t len)
@@ -39,3 +227,12 @@ void bl_flash_write(const uint32_t address, const uint8_t *data, size_t len)
 	flash_program(address, data, len);
 	flash_lock();
 }
+
+void bl_flash_program_words(uint32_t address, const uint32_t *words, uint32_t count)
+{
+	flash_unlock();
+	for (uint32_t i = 0; i < count; ++i) {
+		flash_program_word(address + i * sizeof(uint32_t), words[i]);
+	}
+	flash_lock();
+}
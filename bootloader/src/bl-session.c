@@ -0,0 +1,772 @@
+#include "bl-session.h"
+#include "bl-bus.h"
+#include "bl-flash.h"
+#include "bl-stage.h"
+#include <core/crc32.h>
+#include <core/image-header.h>
+#include <core/logger.h>
+#include <core/str.h>
+#include <core/system.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define DEVICE_ID  (0x69)
+#define SYNC_SEQ_0 (0x11)
+#define SYNC_SEQ_1 (0x22)
+#define SYNC_SEQ_2 (0x33)
+#define SYNC_SEQ_3 (0x44)
+// same sequence with this last byte selects COBS framing for the session
+#define SYNC_SEQ_3_COBS (0x55)
+// and this one bus mode, COBS framed and addressed, nodes answer only when addressed
+#define SYNC_SEQ_3_BUS (0x66)
+// no host showed up, boot the app
+#define SYNC_TIMEOUT_MS (5000)
+// the host talks to one node after another, erasing each of them takes seconds
+#define TIMEOUT_BUS_MS (60000)
+// RFC 6298 bounds, a second until the first reply is measured
+#define RTO_INITIAL_MS (1000)
+#define RTO_MIN_MS     (10)
+#define RTO_MAX_MS     (4000)
+// silence of this many RTOs in a host driven state means the host is gone
+#define IDLE_RTO_MULT (16)
+#define IDLE_MIN_MS   (1000)
+// erasing the whole app area, the loop is blocked meanwhile
+#define ERASE_BUDGET_MS (30000)
+
+// status byte of read_res and crc_res
+enum bl_read_status {
+	bl_read_status_ok,
+	bl_read_status_bad_range,
+	bl_read_status_bad_framing, // readback streams, COBS framing only
+};
+
+static struct bl_session *s_owner;
+
+const char *bl_session_step_str(enum bl_session_step step)
+{
+	switch (step) {
+
+		ENUM_CASE(bl_session_step_sync)
+		ENUM_CASE(bl_session_step_wait_for_update_req)
+		ENUM_CASE(bl_session_step_device_id_req)
+		ENUM_CASE(bl_session_step_device_id_res)
+		ENUM_CASE(bl_session_step_firmware_length_req)
+		ENUM_CASE(bl_session_step_firmware_length_res)
+		ENUM_CASE(bl_session_step_erase_app)
+		ENUM_CASE(bl_session_step_erase_wait)
+		ENUM_CASE(bl_session_step_receive_firmware)
+		ENUM_CASE(bl_session_step_flush_staged)
+		ENUM_CASE(bl_session_step_bus_receive)
+		ENUM_CASE(bl_session_step_done)
+		ENUM_CASE(bl_session_step_finished)
+	default:
+		return "bl_session_step unknown";
+	}
+}
+
+struct bl_session *bl_session_owner(void)
+{
+	return s_owner;
+}
+
+static bool bus_mode(const struct bl_session *session)
+{
+	return session->comms.address != COMMS_ADDR_NONE;
+}
+
+static void finish(struct bl_session *session, enum boot_update_result result,
+		   uint32_t fw_length)
+{
+	timer_wheel_cancel(session->config.timer_wheel, &session->timeout_timer);
+	if (session->comms.isr_mode) {
+		comms_set_isr_mode(&session->comms, false);
+	}
+	session->step = bl_session_step_finished;
+	session->more = false;
+	session->config.done(session, result, fw_length);
+}
+
+static void abort_update(struct bl_session *session, const char *reason)
+{
+	// unsolicited, on a shared bus it would collide with whoever is addressed
+	if (!bus_mode(session)) {
+		comms_send_control_packet(&session->comms, comms_packet_type_fw_update_aborted);
+	}
+
+	logger_printf("received firmare bytes: %" PRIu32 "\n", session->fw_length_received);
+	logger_printf("%s: FW update aborted at: %s, reason: %s, starting the app...\n",
+		      session->config.name, bl_session_step_str(session->step), reason);
+
+	// giving up before the host showed up is a plain boot, not a failed update
+	const enum boot_update_result result = session->step == bl_session_step_sync
+						   ? boot_update_result_none
+						   : boot_update_result_aborted;
+	finish(session, result, session->fw_length_received);
+}
+
+// false if the update was aborted
+static bool receive_verify_packet(struct bl_session *session, enum comms_packet_type type,
+				  struct comms_packet *packet_out)
+{
+	comms_receive(&session->comms, packet_out);
+
+	if (packet_out->type != type) {
+		logger_printf("Expected to received (%s), instead got (%s)\n",
+			      comms_packet_type_str(type), comms_packet_type_str(packet_out->type));
+		abort_update(session, "invalid packet");
+		return false;
+	}
+
+	return true;
+}
+
+static uint32_t get_le32(const uint8_t *src)
+{
+	return src[0] << 0 | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+static void put_le32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = value >> 0;
+	dst[1] = value >> 8;
+	dst[2] = value >> 16;
+	dst[3] = value >> 24;
+}
+
+// fw_version, image_size, image_crc32 (LE), image_status
+static void send_fw_info(struct bl_session *session)
+{
+	const struct image_header *header = NULL;
+	const enum image_status	   status = image_check(
+	       session->config.app_address, session->config.app_address,
+	       bl_flash_get_main_app_available_size(), &header);
+	const uint32_t fields[] = {header->fw_version, header->image_size, header->image_crc32};
+
+	logger_printf("Installed image: %s\n", image_status_str(status));
+
+	struct comms_packet packet = {0};
+	packet.type		   = comms_packet_type_fw_info_res;
+	packet.length		   = 13;
+	memset(packet.data, 0xff, sizeof(packet.data));
+	if (status != image_status_no_header) {
+		for (uint32_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+			put_le32(&packet.data[i * 4], fields[i]);
+		}
+	}
+	packet.data[12] = status;
+	packet.crc	= comms_compute_crc(&packet);
+
+	comms_send(&session->comms, &packet);
+}
+
+static bool app_range_valid(const struct bl_session *session, uint32_t address,
+			    uint32_t length)
+{
+	const uint32_t start = session->config.app_address;
+	const uint32_t size  = bl_flash_get_main_app_available_size();
+
+	return address >= start && length <= size && address - start <= size - length;
+}
+
+static uint32_t flash_crc32(uint32_t address, uint32_t length)
+{
+	const uint64_t start = system_get_us();
+	const uint32_t crc   = crc32((const uint8_t *)(uintptr_t)address, length);
+
+	logger_printf("crc32 of %" PRIu32 " bytes at 0x%08" PRIX32 " took %" PRIu32 " us\n", length,
+		      address, (uint32_t)(system_get_us() - start));
+
+	return crc;
+}
+
+// {address, length} (LE) -> {status, crc32, address} (LE), the address keeps replies of
+// equal ranges apart, the host takes a repeat of its last reply for a retransmission
+static void handle_crc_req(struct bl_session *session, const struct comms_packet *request)
+{
+	const uint32_t address = get_le32(&request->data[0]);
+	const uint32_t length  = get_le32(&request->data[4]);
+
+	struct comms_packet packet = {0};
+	packet.type		   = comms_packet_type_crc_res;
+	packet.length		   = 9;
+	memset(packet.data, 0xff, sizeof(packet.data));
+	packet.data[0] = request->length == 8 && app_range_valid(session, address, length)
+			     ? bl_read_status_ok
+			     : bl_read_status_bad_range;
+	if (packet.data[0] == bl_read_status_ok) {
+		put_le32(&packet.data[1], flash_crc32(address, length));
+	}
+	put_le32(&packet.data[5], address);
+	packet.crc = comms_compute_crc(&packet);
+
+	comms_send(&session->comms, &packet);
+}
+
+// {address, length} (LE) -> {status, crc32 of the range, seq of the first block} (LE),
+// the blocks follow as stream frames, as many as the host granted with ready packets
+static void handle_read_req(struct bl_session *session, const struct comms_packet *request)
+{
+	const uint32_t address = get_le32(&request->data[0]);
+	const uint32_t length  = get_le32(&request->data[4]);
+
+	struct comms_packet packet = {0};
+	packet.type		   = comms_packet_type_read_res;
+	packet.length		   = 9;
+	memset(packet.data, 0xff, sizeof(packet.data));
+
+	// a new request replaces the ongoing one, that is how the host restarts after a loss
+	session->read_address = 0;
+	session->read_end     = 0;
+	session->read_credits = 0;
+
+	if (request->length != 8 || !app_range_valid(session, address, length)) {
+		packet.data[0] = bl_read_status_bad_range;
+	} else if (session->comms.framing != comms_framing_cobs) {
+		packet.data[0] = bl_read_status_bad_framing;
+	} else {
+		packet.data[0] = bl_read_status_ok;
+		put_le32(&packet.data[1], flash_crc32(address, length));
+		put_le32(&packet.data[5], session->comms.stream_seq);
+
+		session->read_address = address;
+		session->read_end     = address + length;
+	}
+	packet.crc = comms_compute_crc(&packet);
+
+	comms_send(&session->comms, &packet);
+}
+
+static void pump_readback(struct bl_session *session)
+{
+	while (session->read_credits > 0 && session->read_address < session->read_end) {
+		const uint32_t left  = session->read_end - session->read_address;
+		const uint32_t block = COMMS_STREAM_PAYLOAD_LEN;
+		const uint32_t len   = left < block ? left : block;
+
+		if (!comms_stream_send(&session->comms,
+				       (const uint8_t *)(uintptr_t)session->read_address, len)) {
+			break;
+		}
+		session->read_address += len;
+		session->read_credits--;
+	}
+}
+
+static void on_timeout(struct timer_wheel_timer *timer, void *ctx)
+{
+	struct bl_session *session = ctx;
+	(void)timer;
+
+	// another port took the update over, this one just stops listening
+	if (s_owner && s_owner != session) {
+		session->step = bl_session_step_finished;
+		return;
+	}
+
+	abort_update(session, "timeout");
+}
+
+// host driven states wait a multiple of the RTO, slow links get their time, fast ones
+// notice a vanished host early
+static uint32_t idle_timeout_ms(const struct bl_session *session)
+{
+	if (session->step == bl_session_step_sync) {
+		return SYNC_TIMEOUT_MS;
+	}
+	if (bus_mode(session)) {
+		return TIMEOUT_BUS_MS;
+	}
+
+	const uint32_t timeout = IDLE_RTO_MULT * rtt_rto(&session->rtt);
+
+	return timeout < IDLE_MIN_MS ? IDLE_MIN_MS : timeout;
+}
+
+static void restart_timeout(struct bl_session *session)
+{
+	timer_wheel_arm(session->config.timer_wheel, &session->timeout_timer,
+			idle_timeout_ms(session), 0);
+}
+
+// the host answers requests right away, the time to its reply is one round trip
+static void send_request(struct bl_session *session, struct comms_packet *packet)
+{
+	comms_send(&session->comms, packet);
+	session->request_pending  = true;
+	session->request_tick	  = system_get_ticks();
+	session->request_retx_cnt = session->comms.stats.rx_packets_cnt[comms_packet_type_retx];
+}
+
+static void send_control_request(struct bl_session *session, enum comms_packet_type type)
+{
+	struct comms_packet packet = {0};
+	packet.type		   = type;
+	packet.length		   = PACKET_DATA_LEN;
+	memset(packet.data, 0xff, sizeof(packet.data));
+	packet.crc = comms_compute_crc(&packet);
+
+	send_request(session, &packet);
+}
+
+// the 96 bit unique ID (LE words)
+static void send_device_id_req(struct bl_session *session)
+{
+	struct comms_packet packet = {0};
+	packet.type		   = comms_packet_type_device_id_req;
+	packet.length		   = sizeof(session->config.unique_id);
+	memset(packet.data, 0xff, sizeof(packet.data));
+	for (uint32_t i = 0; i < packet.length / 4; ++i) {
+		put_le32(&packet.data[i * 4], session->config.unique_id[i]);
+	}
+	packet.crc = comms_compute_crc(&packet);
+
+	send_request(session, &packet);
+}
+
+// data carries the offset of the packet asked for (LE), consecutive readies differ, so a
+// host that asks for the last packet again can tell whether its data got through
+static void send_ready(struct bl_session *session)
+{
+	struct comms_packet packet = {0};
+	packet.type		   = comms_packet_type_ready_for_firmware;
+	packet.length		   = 4;
+	memset(packet.data, 0xff, sizeof(packet.data));
+	put_le32(packet.data, session->fw_length_received);
+	packet.crc = comms_compute_crc(&packet);
+
+	send_request(session, &packet);
+}
+
+static void on_reply(struct bl_session *session)
+{
+	if (!session->request_pending) {
+		return;
+	}
+	session->request_pending = false;
+
+	// Karn's algorithm, after a retransmission the reply may answer either copy
+	if (session->comms.stats.rx_packets_cnt[comms_packet_type_retx] ==
+	    session->request_retx_cnt) {
+		rtt_sample(&session->rtt, (uint32_t)(system_get_ticks() - session->request_tick));
+	}
+}
+
+static void on_bus_block(void *ctx, uint32_t seq, const uint8_t *payload, uint32_t length)
+{
+	struct bl_session *session = ctx;
+
+	bl_bus_take_block(seq, payload, length);
+	restart_timeout(session);
+}
+
+// {start block} (LE) -> {missing count, first missing block at or after start} (LE)
+// and the missing bits of BL_BUS_STATUS_BLOCKS blocks from that one
+static void send_block_status(struct bl_session *session, const struct comms_packet *request)
+{
+	struct comms_packet packet = {0};
+	packet.type		   = comms_packet_type_block_status_res;
+	packet.length		   = 8 + BL_BUS_STATUS_BLOCKS / 8;
+
+	const uint32_t first = bl_bus_status(get_le32(&request->data[0]), &packet.data[8]);
+	put_le32(&packet.data[0], bl_bus_missing());
+	put_le32(&packet.data[4], first);
+	packet.crc = comms_compute_crc(&packet);
+
+	comms_send(&session->comms, &packet);
+}
+
+static void advance_fsm_to(struct bl_session *session, enum bl_session_step step)
+{
+	logger_printf("%s: advancing fsm to %s\n", session->config.name,
+		      bl_session_step_str(step));
+	session->step = step;
+	restart_timeout(session);
+	session->more = true;
+}
+
+static void step_sync(struct bl_session *session)
+{
+	uint8_t byte = 0;
+
+	if (s_owner) {
+		// the update belongs to another port, keep the receive buffer from filling up
+		while (transport_read(session->config.transport, &byte, 1) == 1) {
+		}
+		return;
+	}
+
+	while (session->step == bl_session_step_sync &&
+	       transport_read(session->config.transport, &byte, 1) == 1) {
+		session->sync_seq[0] = session->sync_seq[1];
+		session->sync_seq[1] = session->sync_seq[2];
+		session->sync_seq[2] = session->sync_seq[3];
+		session->sync_seq[3] = byte;
+
+		const bool sync_prefix = session->sync_seq[0] == SYNC_SEQ_0 &&
+					 session->sync_seq[1] == SYNC_SEQ_1 &&
+					 session->sync_seq[2] == SYNC_SEQ_2;
+
+		if (sync_prefix && session->sync_seq[3] == SYNC_SEQ_3_BUS) {
+			// every node sees the sequence, an answer would collide
+			s_owner = session;
+			comms_set_address(&session->comms, session->config.bus_address);
+			logger_printf("%s: sync seq observed, bus mode, address 0x%02X\n",
+				      session->config.name, session->comms.address);
+			advance_fsm_to(session, bl_session_step_wait_for_update_req);
+		} else if (sync_prefix && (session->sync_seq[3] == SYNC_SEQ_3 ||
+					   session->sync_seq[3] == SYNC_SEQ_3_COBS)) {
+			const bool cobs = session->sync_seq[3] == SYNC_SEQ_3_COBS;
+
+			s_owner = session;
+			logger_printf("%s: sync seq observed, %s framing\n", session->config.name,
+				      cobs ? "cobs" : "fixed");
+
+			comms_set_framing(&session->comms,
+					  cobs ? comms_framing_cobs : comms_framing_fixed);
+			// bus nodes stay in the main loop, stream blocks are programmed from the
+			// handler and that must not happen in an ISR
+			if (session->config.isr_rx && !comms_set_isr_mode(&session->comms, true)) {
+				logger_printf("%s: no rx handler, parsing in the main loop\n",
+					      session->config.name);
+			}
+			comms_send_control_packet(&session->comms, comms_packet_type_seq_observed);
+			advance_fsm_to(session, bl_session_step_wait_for_update_req);
+		}
+	}
+}
+
+static void step_wait_for_update_req(struct bl_session *session)
+{
+	struct comms_packet request = {0};
+	comms_receive(&session->comms, &request);
+
+	switch (request.type) {
+	case comms_packet_type_fw_info_req: {
+		// host decides on the installed image, stay here for its verdict
+		send_fw_info(session);
+		restart_timeout(session);
+	} break;
+	case comms_packet_type_fw_update_aborted: {
+		logger_printf("Host reports the installed image is up to date\n");
+		finish(session, boot_update_result_none, 0);
+	} break;
+	case comms_packet_type_fw_update_req: {
+		comms_send_control_packet(&session->comms, comms_packet_type_fw_update_res);
+		advance_fsm_to(session, bl_session_step_device_id_req);
+	} break;
+	case comms_packet_type_crc_req: {
+		handle_crc_req(session, &request);
+		restart_timeout(session);
+	} break;
+	case comms_packet_type_read_req: {
+		handle_read_req(session, &request);
+		restart_timeout(session);
+	} break;
+	case comms_packet_type_ready_for_firmware: {
+		// same flow control as uploads, in the other direction,
+		// data[0] is the number of blocks the host has room for
+		session->read_credits += request.length == 1 ? request.data[0] : 1;
+		pump_readback(session);
+		restart_timeout(session);
+	} break;
+	default: {
+		logger_printf("Expected update request, instead got (%s)\n",
+			      comms_packet_type_str(request.type));
+		abort_update(session, "invalid packet");
+	}
+	}
+}
+
+static void step_device_id_res(struct bl_session *session)
+{
+	struct comms_packet packet = {0};
+	if (!receive_verify_packet(session, comms_packet_type_device_id_res, &packet)) {
+		return;
+	}
+	on_reply(session);
+
+	if (packet.length != 1) {
+		abort_update(session, "invalid length of device_id_req packet");
+		return;
+	}
+	if (packet.data[0] != DEVICE_ID) {
+		abort_update(session, "invalid device id");
+		return;
+	}
+	advance_fsm_to(session, bl_session_step_firmware_length_req);
+}
+
+static void step_firmware_length_res(struct bl_session *session)
+{
+	struct comms_packet packet = {0};
+	if (!receive_verify_packet(session, comms_packet_type_fw_length_res, &packet)) {
+		return;
+	}
+	on_reply(session);
+
+	if (packet.length != 4) {
+		abort_update(session, "invalid length of fw_length_packet");
+		return;
+	}
+
+	const uint32_t fw_length = get_le32(packet.data);
+	logger_printf("new firmware size is %" PRIu32 "\n", fw_length);
+
+	if (fw_length > bl_flash_get_main_app_available_size()) {
+		abort_update(session, "firmware size exceeded");
+		return;
+	}
+
+	session->fw_length = fw_length;
+	advance_fsm_to(session, bl_session_step_erase_app);
+}
+
+static void erase_done(struct bl_session *session)
+{
+	if (bus_mode(session)) {
+		// the ready only tells the host this node waits for the broadcast
+		bl_bus_setup(session->config.update_address, session->fw_length);
+		comms_set_stream_handler(&session->comms, on_bus_block, session);
+		comms_send_control_packet(&session->comms, comms_packet_type_ready_for_firmware);
+		advance_fsm_to(session, bl_session_step_bus_receive);
+		return;
+	}
+
+	bl_stage_setup(session->config.update_address);
+	session->receive_start_us = system_get_us();
+	send_ready(session);
+	advance_fsm_to(session, bl_session_step_receive_firmware);
+}
+
+static void step_erase_app(struct bl_session *session)
+{
+	struct timer_wheel *tw = session->config.timer_wheel;
+
+	if (bl_flash_is_dual_bank()) {
+		// code keeps running from this bank while the other one erases, acks and the
+		// other ports are served in between, ERASE_BUDGET_MS still bounds the whole erase
+		bl_flash_erase_start();
+		advance_fsm_to(session, bl_session_step_erase_wait);
+		timer_wheel_arm(tw, &session->timeout_timer, ERASE_BUDGET_MS, 0);
+		return;
+	}
+
+	// the loop is blocked while erasing, the wheel catches up right after it, an
+	// erase over budget aborts and the next timeout is armed from the current tick
+	timer_wheel_arm(tw, &session->timeout_timer, ERASE_BUDGET_MS, 0);
+	bl_flash_erase_main_app();
+	timer_wheel_update(tw, system_get_ticks());
+	if (session->step != bl_session_step_erase_app) {
+		return;
+	}
+
+	erase_done(session);
+}
+
+// polls BSY, one sector is started per step
+static void step_erase_wait(struct bl_session *session)
+{
+	if (!bl_flash_erase_step()) {
+		session->more = true;
+		return;
+	}
+
+	erase_done(session);
+}
+
+static void step_receive_firmware(struct bl_session *session)
+{
+	if (comms_packet_available(&session->comms)) {
+		struct comms_packet packet = {0};
+		if (!receive_verify_packet(session, comms_packet_type_data, &packet)) {
+			return;
+		}
+
+		const uint8_t length	   = packet.length & ~PACKET_LEN_ODD;
+		const bool    odd	   = (packet.length & PACKET_LEN_ODD) != 0;
+		const bool    expected_odd = (session->fw_length_received / PACKET_DATA_LEN) % 2;
+
+		if (length > PACKET_DATA_LEN) {
+			abort_update(session, "invalid length of data packet");
+			return;
+		}
+
+		if (odd != expected_odd) {
+			// the host resent a packet whose ack it lost, already staged
+			logger_printf("Duplicate data packet dropped\n");
+		} else {
+			on_reply(session);
+
+			// cannot overflow, the host sends a packet only when asked to
+			bl_stage_push(packet.data, length);
+			session->fw_length_received += length;
+
+			if (session->fw_length_received >= session->fw_length) {
+				advance_fsm_to(session, bl_session_step_flush_staged);
+				return;
+			}
+
+			session->ready_pending = true;
+		}
+		restart_timeout(session);
+	}
+
+	// ask for the next packet before programming, flash time hides behind link time
+	if (session->ready_pending && bl_stage_space() >= PACKET_DATA_LEN) {
+		session->ready_pending = false;
+		send_ready(session);
+	}
+
+	if (bl_stage_pending() >= BL_STAGE_BURST_LEN) {
+		bl_stage_program_burst(false);
+		// one burst per step, packets that arrived meanwhile are handled first
+		session->more = true;
+	}
+}
+
+static void step_flush_staged(struct bl_session *session)
+{
+	if (bl_stage_program_burst(true) > 0) {
+		restart_timeout(session);
+		session->more = true;
+		return;
+	}
+
+	const struct bl_stage_stats *stats   = bl_stage_get_stats();
+	const uint64_t		     took_us = system_get_us() - session->receive_start_us;
+	logger_printf("received %" PRIu32 " bytes in %" PRIu32 " ms, %" PRIu32
+		      " ms of it programming in %" PRIu32 " bursts, staging peak %" PRIu32
+		      " bytes\n",
+		      stats->staged, (uint32_t)(took_us / 1000), stats->program_us / 1000,
+		      stats->bursts, stats->max_fill);
+	advance_fsm_to(session, bl_session_step_done);
+}
+
+// blocks are programmed from on_bus_block, packets are only status and commit
+static void step_bus_receive(struct bl_session *session)
+{
+	struct comms_packet request = {0};
+	comms_receive(&session->comms, &request);
+
+	switch (request.type) {
+	case comms_packet_type_block_status_req: {
+		send_block_status(session, &request);
+		restart_timeout(session);
+	} break;
+	case comms_packet_type_update_successful: {
+		if (bl_bus_missing() > 0) {
+			logger_printf("Commit with %" PRIu32 " blocks missing, ignored\n",
+				      bl_bus_missing());
+			break;
+		}
+		comms_set_stream_handler(&session->comms, NULL, NULL);
+		session->fw_length_received = session->fw_length;
+		advance_fsm_to(session, bl_session_step_done);
+	} break;
+	default: {
+		logger_printf("Unexpected (%s) while receiving the broadcast\n",
+			      comms_packet_type_str(request.type));
+	}
+	}
+}
+
+static void step_done(struct bl_session *session)
+{
+	// dual bank the image is checked in the other bank, it is linked to run at app_address
+	const struct image_header *header   = NULL;
+	const uint32_t		   max_size = bl_flash_get_main_app_available_size();
+	const enum image_status	   status   = image_check(
+	       session->config.update_address, session->config.app_address, max_size, &header);
+
+	// images without a header are accepted as before, only a broken digest fails
+	logger_printf("fw update done, image: %s\n", image_status_str(status));
+	finish(session,
+	       status == image_status_corrupt ? boot_update_result_aborted
+					      : boot_update_result_done,
+	       session->fw_length_received);
+}
+
+void bl_session_setup(struct bl_session *session, const struct bl_session_config *config)
+{
+	if (s_owner == session) {
+		s_owner = NULL;
+	}
+
+	memset(session, 0, sizeof(*session));
+	session->config = *config;
+	session->step	= bl_session_step_sync;
+
+	comms_setup(&session->comms, config->transport);
+	rtt_setup(&session->rtt, RTO_INITIAL_MS, RTO_MIN_MS, RTO_MAX_MS);
+	timer_wheel_timer_setup(&session->timeout_timer, on_timeout, session);
+	restart_timeout(session);
+}
+
+bool bl_session_step(struct bl_session *session)
+{
+	if (session->step == bl_session_step_finished) {
+		return false;
+	}
+	// before the sync the port carries raw bytes, not packets
+	if (session->step != bl_session_step_sync) {
+		comms_update(&session->comms);
+	}
+
+	const bool packet = comms_packet_available(&session->comms);
+	session->more	  = false;
+
+	switch (session->step) {
+	case bl_session_step_sync:
+		step_sync(session);
+		break;
+	case bl_session_step_wait_for_update_req:
+		if (packet) {
+			step_wait_for_update_req(session);
+		}
+		break;
+	case bl_session_step_device_id_req:
+		send_device_id_req(session);
+		advance_fsm_to(session, bl_session_step_device_id_res);
+		break;
+	case bl_session_step_device_id_res:
+		if (packet) {
+			step_device_id_res(session);
+		}
+		break;
+	case bl_session_step_firmware_length_req:
+		send_control_request(session, comms_packet_type_fw_length_req);
+		advance_fsm_to(session, bl_session_step_firmware_length_res);
+		break;
+	case bl_session_step_firmware_length_res:
+		if (packet) {
+			step_firmware_length_res(session);
+		}
+		break;
+	case bl_session_step_erase_app:
+		step_erase_app(session);
+		break;
+	case bl_session_step_erase_wait:
+		step_erase_wait(session);
+		break;
+	case bl_session_step_receive_firmware:
+		step_receive_firmware(session);
+		break;
+	case bl_session_step_flush_staged:
+		step_flush_staged(session);
+		break;
+	case bl_session_step_bus_receive:
+		if (packet) {
+			step_bus_receive(session);
+		}
+		break;
+	case bl_session_step_done:
+		step_done(session);
+		break;
+	case bl_session_step_finished:
+		break;
+	}
+
+	// a burst may have carried more than one packet, come back for the rest
+	return session->more || (session->step != bl_session_step_finished &&
+				 comms_packet_available(&session->comms));
+}
@@ -0,0 +1,85 @@
+#include "bl-stage.h"
+#include "bl-flash.h"
+#include <core/cache.h>
+#include <core/ring_buffer.h>
+#include <core/system.h>
+#include <string.h>
+
+// not worth zeroing at reset, every byte is written before it is read
+__attribute__((section(".noinit"), aligned(4))) static uint8_t s_stage_buffer[BL_STAGE_SIZE];
+
+static struct ring_buffer    s_stage_rb;
+static uint32_t		     s_flash_address;
+static uint32_t		     s_flash_start;
+static struct bl_stage_stats s_stats;
+
+void bl_stage_setup(uint32_t flash_address)
+{
+	ring_buffer_setup(&s_stage_rb, s_stage_buffer, sizeof(s_stage_buffer));
+	s_flash_address = flash_address;
+	s_flash_start	= flash_address;
+	memset(&s_stats, 0, sizeof(s_stats));
+}
+
+uint32_t bl_stage_space(void)
+{
+	return ring_buffer_get_left_space_len(&s_stage_rb);
+}
+
+uint32_t bl_stage_pending(void)
+{
+	return ring_buffer_get_data_len(&s_stage_rb);
+}
+
+bool bl_stage_push(const uint8_t *data, uint32_t len)
+{
+	if (!ring_buffer_write_many(&s_stage_rb, data, len)) {
+		return false;
+	}
+
+	s_stats.staged += len;
+	if (bl_stage_pending() > s_stats.max_fill) {
+		s_stats.max_fill = bl_stage_pending();
+	}
+
+	return true;
+}
+
+uint32_t bl_stage_program_burst(bool flush)
+{
+	uint32_t words[BL_STAGE_BURST_LEN / sizeof(uint32_t)];
+	uint32_t len = bl_stage_pending();
+
+	if (len > sizeof(words)) {
+		len = sizeof(words);
+	}
+	if (!flush) {
+		len &= ~(sizeof(uint32_t) - 1);
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	// the image tail is padded with what an erased word reads as anyway
+	memset(words, 0xff, sizeof(words));
+	ring_buffer_read_many(&s_stage_rb, (uint8_t *)words, len);
+
+	const uint32_t word_cnt = (len + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+	const uint64_t start	= system_get_us();
+
+	bl_flash_program_words(s_flash_address, words, word_cnt);
+	// lines of this range may hold the erased content, later reads must see the new one
+	cache_invalidate_dcache((void *)(uintptr_t)s_flash_address, word_cnt * sizeof(uint32_t));
+
+	s_flash_address += word_cnt * sizeof(uint32_t);
+	s_stats.programmed = s_flash_address - s_flash_start;
+	s_stats.bursts++;
+	s_stats.program_us += (uint32_t)(system_get_us() - start);
+
+	return len;
+}
+
+const struct bl_stage_stats *bl_stage_get_stats(void)
+{
+	return &s_stats;
+}
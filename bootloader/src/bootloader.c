@@ -1,22 +1,32 @@
+#include "bl-session.h"
 #include "bl-flash.h"
-#include "comms.h"
+#include "cache-bench.h"
+#include "core/comms.h"
 #include "core/system.h"
+#include <core/boot-handoff.h>
+#include <core/cache.h>
+#include <core/crc8.h>
+#include <core/event-loop.h>
 #include <core/logger.h>
-#include <core/simple-timer.h>
-#include <core/str.h>
+#include <core/rtt.h>
+#include <core/tcm.h>
+#include <core/timer-wheel.h>
 #include <core/uart.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scb.h>
 #include <libopencm3/cm3/vector.h>
+#include <libopencm3/stm32/desig.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/usart.h>
 #include <stdint.h>
-#include <stdio.h>
+#include <string.h>
 
 #define MAIN_APP_START_ADDRESS (FLASH_BASE + BOOTLOADER_SIZE)
 
-static struct uart_driver s_uart_firmware_io = {
+#define EVENT_BL_FSM EVENT_USER(0)
+
+TCM_DATA static struct uart_driver s_uart_firmware_io = {
     .usart_dev	     = USART3,
     .usart_clock_dev = RCC_USART3,
     .nvic_irq	     = NVIC_USART3_IRQ,
@@ -26,273 +36,214 @@ static struct uart_driver s_uart_firmware_io = {
     .gpio_af	     = GPIO_AF7,
     .baud_rate	     = 115200,
     .mode	     = USART_MODE_TX_RX,
+#ifdef BL_COMMS_ISR
+    .tx_irq = true,
+#endif
+#ifdef UART_FLOW_CONTROL
+    // not routed to the ST-LINK VCP, needs an external adapter on PD11/PD12
+    .cts_pin = GPIO11,
+    .rts_pin = GPIO12,
+#endif
 };
 
-struct comms comms = {0};
+#ifdef BL_SECOND_PORT
+// Arduino D0/D1 of the Nucleo-144 header, PG9 RX, PG14 TX
+TCM_DATA static struct uart_driver s_uart_second_io = {
+    .usart_dev	     = USART6,
+    .usart_clock_dev = RCC_USART6,
+    .nvic_irq	     = NVIC_USART6_IRQ,
+    .gpio_pins	     = GPIO9 | GPIO14,
+    .gpio_port	     = GPIOG,
+    .gpio_port_clk   = RCC_GPIOG,
+    .gpio_af	     = GPIO_AF8,
+    .baud_rate	     = 115200,
+    .mode	     = USART_MODE_TX_RX,
+#ifdef BL_COMMS_ISR
+    .tx_irq = true,
+#endif
+};
+#endif
 
-static void go_to_app_main(void)
-{
-	comms_print_stats(&comms);
-	printf("Closing UART FW update ifc\n");
-	uart_terminate(&s_uart_firmware_io);
-	printf("Closing logger resources... jumping to main app\n\n");
-	destroy_logger();
+struct bl_port {
+	const char	   *name;
+	struct uart_driver *uart;
+	struct transport    transport;
+	struct bl_session   session;
+};
 
-	vector_table_t *vector_table = (vector_table_t *)MAIN_APP_START_ADDRESS;
-	vector_table->reset();
-}
+// each port runs a session until one of them sees the sync sequence
+TCM_DATA static struct bl_port s_ports[] = {
+    {.name = "USART3", .uart = &s_uart_firmware_io},
+#ifdef BL_SECOND_PORT
+    {.name = "USART6", .uart = &s_uart_second_io},
+#endif
+};
 
-void usart3_isr(void)
-{
-	uart_handle_irq(&s_uart_firmware_io);
-}
+#define PORT_CNT (sizeof(s_ports) / sizeof(s_ports[0]))
 
-#define DEVICE_ID  (0x69)
-#define SYNC_SEQ_0 (0x11)
-#define SYNC_SEQ_1 (0x22)
-#define SYNC_SEQ_2 (0x33)
-#define SYNC_SEQ_3 (0x44)
-#define TIMEOUT_MS (5000)
-
-enum bl_state_step {
-	bl_state_step_sync,
-	bl_state_step_wait_for_update_req,
-	bl_state_step_device_id_req,
-	bl_state_step_device_id_res,
-	bl_state_step_firmware_length_req,
-	bl_state_step_firmware_length_res,
-	bl_state_step_erase_app,
-	bl_state_step_receive_firmware,
-	bl_state_step_done,
-};
+static struct timer_wheel s_timer_wheel;
 
-static const char *bl_state_step_str(enum bl_state_step step)
+static void print_uart_stats(const struct uart_driver *drv)
 {
-	switch (step) {
-
-		ENUM_CASE(bl_state_step_sync)
-		ENUM_CASE(bl_state_step_wait_for_update_req)
-		ENUM_CASE(bl_state_step_device_id_req)
-		ENUM_CASE(bl_state_step_device_id_res)
-		ENUM_CASE(bl_state_step_firmware_length_req)
-		ENUM_CASE(bl_state_step_firmware_length_res)
-		ENUM_CASE(bl_state_step_erase_app)
-		ENUM_CASE(bl_state_step_receive_firmware)
-		ENUM_CASE(bl_state_step_done)
-	default:
-		return "bl_state_step unknown";
-	}
+	logger_printf("UART Stats:\n");
+	logger_printf("Overrun count: %lu\n", drv->stats.overrun_cnt);
+	logger_printf("Framing error count: %lu\n", drv->stats.framing_err_cnt);
+	logger_printf("Noise count: %lu\n", drv->stats.noise_cnt);
+	logger_printf("Parity error count: %lu\n", drv->stats.parity_err_cnt);
+	logger_printf("Ring buffer overflow count: %lu\n", drv->stats.rb_overflow_cnt);
+	logger_printf("RTS throttle count: %lu\n", drv->stats.rts_throttle_cnt);
 }
 
-struct bl_state {
-	enum bl_state_step  step;
-	uint8_t		    sync_seq[4];
-	uint32_t	    fw_length;
-	uint32_t	    fw_length_received;
-	struct simple_timer timeout_timer;
-};
-
-static struct bl_state bl_state = {
-    .step		= bl_state_step_sync,
-    .sync_seq		= {0},
-    .fw_length		= 0,
-    .fw_length_received = 0,
-    .timeout_timer	= {0},
-};
+static void go_to_app_main(struct bl_session *session, enum boot_update_result result,
+			   uint32_t fw_length)
+{
+	const struct bl_port	   *port = session->config.ctx;
+	const struct rtt_estimator *rtt	 = &session->rtt;
 
+	comms_print_stats(&session->comms);
+	print_uart_stats(port->uart);
+	logger_printf("RTT: srtt %lu ms, rttvar %lu ms, rto %lu ms, %lu samples\n",
+		      rtt_srtt(rtt), rtt_rttvar(rtt), rtt_rto(rtt), rtt->sample_cnt);
 
-static void abort_fw_update(const char *reason)
-{
-	comms_send_control_packet(&comms, comms_packet_type_fw_update_aborted);
+	// dual bank the new image is in the other bank until the swap, the old one keeps
+	// booting if the commit fails
+	if (result == boot_update_result_done && bl_flash_is_dual_bank()) {
+		const bool committed = bl_flash_commit();
 
-	printf("received firmare bytes: %lu\n", bl_state.fw_length_received);
-	printf("Bootloader FW update aborted at: %s, reason: %s, starting the "
-	       "app...\n",
-	       bl_state_step_str(bl_state.step), reason);
+		logger_printf("Bank swap %s\n", committed ? "done" : "failed");
+		result = committed ? result : boot_update_result_aborted;
+	}
 
-	go_to_app_main();
+	logger_printf("Closing UART FW update ifc\n");
+	for (uint32_t i = 0; i < PORT_CNT; ++i) {
+		uart_terminate(s_ports[i].uart);
+	}
+	logger_printf("Closing logger resources... jumping to main app\n\n");
+	destroy_logger();
+	// the tick handler lives in ITCM, which the app reloads with its own code
+	system_terminate();
+	cache_disable();
+
+	boot_handoff_publish(result, fw_length);
+
+	// enter the app the way the core enters reset: its vector table, its stack
+	const vector_table_t *vector_table = (const vector_table_t *)MAIN_APP_START_ADDRESS;
+	SCB_VTOR			   = MAIN_APP_START_ADDRESS;
+	__asm__ volatile("dsb\n\t"
+			 "isb\n\t"
+			 "msr msp, %0\n\t"
+			 "bx %1"
+			 :
+			 : "r"(vector_table->initial_sp_value), "r"(vector_table->reset)
+			 : "memory");
+	__builtin_unreachable();
 }
 
-static void receive_verify_packet(enum comms_packet_type type, struct comms_packet *packet_out)
+TCM_TEXT void usart3_isr(void)
 {
-	enum comms_packet_type actual_packet_type = 0;
-	if (packet_out) {
-		comms_receive(&comms, packet_out);
-		actual_packet_type = packet_out->type;
-	} else {
-		struct comms_packet tmp_packet = {0};
-		comms_receive(&comms, &tmp_packet);
-		actual_packet_type = tmp_packet.type;
-	}
+	uart_handle_irq(&s_uart_firmware_io);
+}
 
-	if (actual_packet_type != type) {
-		printf("Expected to received (%s), instead got (%s)\n", comms_packet_type_str(type),
-		       comms_packet_type_str(actual_packet_type));
-		abort_fw_update("invalid packet");
-	}
+#ifdef BL_SECOND_PORT
+TCM_TEXT void usart6_isr(void)
+{
+	uart_handle_irq(&s_uart_second_io);
 }
+#endif
 
-static void receive_verify_control_packet(enum comms_packet_type type)
+// 1..0x7E, BUS_ADDRESS from the build or derived from the unique device ID, the host
+// sees two unique IDs answer to one address and nodes that collide need BUS_ADDRESS
+static uint8_t bus_address(uint32_t uid[3])
 {
-	receive_verify_packet(type, NULL);
+#ifdef BUS_ADDRESS
+	(void)uid;
+	return BUS_ADDRESS;
+#else
+	return 1 + crc8((uint8_t *)uid, 3 * sizeof(uint32_t)) % (COMMS_ADDR_BROADCAST - 1);
+#endif
 }
 
-static void check_timeout(void)
+static void on_port_event(uint32_t events, void *ctx)
 {
-	if (simple_timer_has_elapsed(&bl_state.timeout_timer)) {
-		abort_fw_update("timeout");
+	(void)events;
+	(void)ctx;
+
+	bool more = false;
+	for (uint32_t i = 0; i < PORT_CNT; ++i) {
+		more |= bl_session_step(&s_ports[i].session);
+	}
+
+	if (more) {
+		event_loop_post(EVENT_BL_FSM);
 	}
 }
 
-static void advance_fsm_to(enum bl_state_step step)
+// ISRs must not fetch their vectors from flash while it is being programmed, a read of
+// the bank stalls until the program operation completes
+TCM_BSS static vector_table_t s_ram_vector_table __attribute__((aligned(512)));
+
+static void relocate_vector_table(void)
 {
-	printf("Advancing fsm to %s\n", bl_state_step_str(step));
-	simple_timer_reset(&bl_state.timeout_timer);
-	bl_state.step = step;
+	memcpy(&s_ram_vector_table, &vector_table, sizeof(s_ram_vector_table));
+	SCB_VTOR = (uint32_t)(uintptr_t)&s_ram_vector_table;
+	__asm__ volatile("dsb\n\tisb" ::: "memory");
 }
 
 int main(void)
 {
+	// the swap changes what app addresses read, it must happen before anything is cached
+	bl_flash_select_bank();
 	system_setup();
-	uart_setup(&s_uart_firmware_io);
-	stdout = create_logger();
-	printf("Booting device...\n");
+	relocate_vector_table();
+	boot_handoff_begin();
+	for (uint32_t i = 0; i < PORT_CNT; ++i) {
+		uart_setup(s_ports[i].uart);
+	}
+	logger_setup();
+	logger_printf("Booting device...\n");
 
-	comms_setup(&comms, &s_uart_firmware_io);
-	printf("Comms setup done\n");
+#ifdef CACHE_BENCH
+	cache_bench_run();
+#endif
 
 	if (bl_flash_is_dual_bank()) {
+		logger_printf("Dual bank, updates go to 0x%08lX\n", bl_flash_get_update_address());
+	}
 
-		printf("Dual bank is enabled, cannot perform flash operation\n");
-		return 1;
+	timer_wheel_setup(&s_timer_wheel, system_get_ticks());
+
+	uint32_t uid[3];
+	desig_get_unique_id(uid);
+
+	for (uint32_t i = 0; i < PORT_CNT; ++i) {
+		struct bl_port		       *port   = &s_ports[i];
+		const struct bl_session_config config = {
+		    .name	    = port->name,
+		    .transport	    = &port->transport,
+		    .timer_wheel    = &s_timer_wheel,
+		    .app_address    = MAIN_APP_START_ADDRESS,
+		    .update_address = bl_flash_get_update_address(),
+		    .bus_address    = bus_address(uid),
+		    .unique_id	    = {uid[0], uid[1], uid[2]},
+		    .done	    = go_to_app_main,
+		    .ctx	    = port,
+#ifdef BL_COMMS_ISR
+		    .isr_rx = true,
+#endif
+		};
+
+		uart_transport_setup(&port->transport, port->uart);
+		bl_session_setup(&port->session, &config);
 	}
+	logger_printf("Comms setup done\n");
 
-	simple_timer_setup(&bl_state.timeout_timer, TIMEOUT_MS, false);
+	event_loop_setup(&s_timer_wheel);
+	event_loop_subscribe(EVENT_UART_RX | EVENT_BL_FSM, on_port_event, NULL);
 
-	printf("Waiting for FW update sync...\n");
+	logger_printf("Waiting for FW update sync...\n");
 
 	while (true) {
-		check_timeout();
-
-		switch (bl_state.step) {
-		case bl_state_step_sync: {
-			if (uart_data_available(&s_uart_firmware_io)) {
-				bl_state.sync_seq[0] = bl_state.sync_seq[1];
-				bl_state.sync_seq[1] = bl_state.sync_seq[2];
-				bl_state.sync_seq[2] = bl_state.sync_seq[3];
-				bl_state.sync_seq[3] = uart_read_byte(&s_uart_firmware_io);
-
-				if (bl_state.sync_seq[0] == SYNC_SEQ_0 &&
-				    bl_state.sync_seq[1] == SYNC_SEQ_1 &&
-				    bl_state.sync_seq[2] == SYNC_SEQ_2 &&
-				    bl_state.sync_seq[3] == SYNC_SEQ_3) {
-
-					printf("Sync seq observed, sending seq observed\n");
-
-					comms_send_control_packet(&comms,
-								  comms_packet_type_seq_observed);
-					advance_fsm_to(bl_state_step_wait_for_update_req);
-				} else {
-					check_timeout();
-				}
-			}
-		} break;
-		case bl_state_step_wait_for_update_req: {
-			comms_update(&comms);
-			if (comms_packet_available(&comms)) {
-				receive_verify_control_packet(comms_packet_type_fw_update_req);
-				comms_send_control_packet(&comms, comms_packet_type_fw_update_res);
-				advance_fsm_to(bl_state_step_device_id_req);
-			}
-
-		} break;
-		case bl_state_step_device_id_req: {
-			comms_send_control_packet(&comms, comms_packet_type_device_id_req);
-			advance_fsm_to(bl_state_step_device_id_res);
-
-		} break;
-		case bl_state_step_device_id_res: {
-			comms_update(&comms);
-			if (comms_packet_available(&comms)) {
-				struct comms_packet device_id_res_packet = {0};
-				receive_verify_packet(comms_packet_type_device_id_res,
-						      &device_id_res_packet);
-
-				if (device_id_res_packet.length != 1) {
-					abort_fw_update("invalid length of device_id_req packet");
-				}
-				if (device_id_res_packet.data[0] != DEVICE_ID) {
-					abort_fw_update("invalid device id");
-				}
-				advance_fsm_to(bl_state_step_firmware_length_req);
-			}
-		} break;
-		case bl_state_step_firmware_length_req: {
-			comms_send_control_packet(&comms, comms_packet_type_fw_length_req);
-			advance_fsm_to(bl_state_step_firmware_length_res);
-		} break;
-		case bl_state_step_firmware_length_res: {
-			comms_update(&comms);
-			if (comms_packet_available(&comms)) {
-				struct comms_packet fw_length_packet = {0};
-				receive_verify_packet(comms_packet_type_fw_length_res,
-						      &fw_length_packet);
-
-				if (fw_length_packet.length != 4) {
-					abort_fw_update("invalid length of fw_length_packet");
-				}
-
-				const uint32_t fw_length =
-				    fw_length_packet.data[0] << 0 | fw_length_packet.data[1] << 8 |
-				    fw_length_packet.data[2] << 16 | fw_length_packet.data[3] << 24;
-
-				printf("new firmware size is %lu\n", fw_length);
-
-				if (fw_length > bl_flash_get_main_app_available_size()) {
-					abort_fw_update("firmware size exceeded");
-				}
-
-				bl_state.fw_length = fw_length;
-				advance_fsm_to(bl_state_step_erase_app);
-			}
-		} break;
-		case bl_state_step_erase_app: {
-			bl_flash_erase_main_app();
-			comms_send_control_packet(&comms, comms_packet_type_ready_for_firmware);
-			advance_fsm_to(bl_state_step_receive_firmware);
-		} break;
-		case bl_state_step_receive_firmware: {
-			comms_update(&comms);
-			if (comms_packet_available(&comms)) {
-				struct comms_packet data_packet = {0};
-				receive_verify_packet(comms_packet_type_data, &data_packet);
-				
-
-				bl_flash_write(MAIN_APP_START_ADDRESS + bl_state.fw_length_received,
-					       data_packet.data, data_packet.length);
-				bl_state.fw_length_received += data_packet.length;
-
-				if (bl_state.fw_length_received >= bl_state.fw_length) {
-					advance_fsm_to(bl_state_step_done);
-					break;
-				} else {
-					comms_send_control_packet(
-					    &comms, comms_packet_type_ready_for_firmware);
-				}
-
-				simple_timer_reset(&bl_state.timeout_timer);
-			}
-
-		} break;
-		case bl_state_step_done: {
-			printf("fw update done!\n");
-			go_to_app_main();
-
-		} break;
-		default:
-			advance_fsm_to(bl_state_step_sync);
-			break;
-		}
+		event_loop_run_once();
 	}
 
 	return 0;
@@ -0,0 +1,92 @@
+#include "cache-bench.h"
+#include "core/cache.h"
+#include "core/comms.h"
+#include "core/crc8.h"
+#include "core/logger.h"
+#include "core/loopback.h"
+#include "core/system.h"
+#include <string.h>
+
+#define BENCH_ROUNDS  16
+#define BENCH_CRC_LEN 4096
+// stays below PACKET_RB_LEN so no packet gets rejected as buffer full
+#define BENCH_PACKETS 12
+#define BENCH_IN_LEN  512
+
+static uint8_t	       s_crc_data[BENCH_CRC_LEN];
+static uint8_t	       s_stream[BENCH_PACKETS * sizeof(struct comms_packet)];
+static uint8_t	       s_loopback_in[BENCH_IN_LEN];
+static struct loopback s_loopback;
+static struct comms    s_comms;
+
+static void prepare_stream(void)
+{
+	for (uint32_t i = 0; i < BENCH_CRC_LEN; ++i) {
+		s_crc_data[i] = (uint8_t)(i * 31 + 7);
+	}
+
+	for (uint32_t i = 0; i < BENCH_PACKETS; ++i) {
+		struct comms_packet packet = {
+		    .length = PACKET_DATA_LEN,
+		    .type   = comms_packet_type_data,
+		};
+		memcpy(packet.data, &s_crc_data[i * PACKET_DATA_LEN], PACKET_DATA_LEN);
+		packet.crc = comms_compute_crc(&packet);
+		memcpy(&s_stream[i * sizeof(packet)], &packet, sizeof(packet));
+	}
+}
+
+static uint32_t bench_crc8(void)
+{
+	const uint32_t start = system_get_cycles();
+
+	for (uint32_t i = 0; i < BENCH_ROUNDS; ++i) {
+		s_crc_data[0] = crc8(s_crc_data, BENCH_CRC_LEN);
+	}
+
+	return (system_get_cycles() - start) / BENCH_ROUNDS;
+}
+
+static uint32_t bench_comms_update(void)
+{
+	uint32_t total = 0;
+
+	for (uint32_t i = 0; i < BENCH_ROUNDS; ++i) {
+		loopback_feed(&s_loopback, s_stream, sizeof(s_stream));
+
+		const uint32_t start = system_get_cycles();
+		comms_update(&s_comms);
+		total += system_get_cycles() - start;
+
+		struct comms_packet packet = {0};
+		while (comms_packet_available(&s_comms)) {
+			comms_receive(&s_comms, &packet);
+		}
+	}
+
+	return total / BENCH_ROUNDS;
+}
+
+void cache_bench_run(void)
+{
+	prepare_stream();
+	loopback_setup(&s_loopback, s_loopback_in, sizeof(s_loopback_in), NULL, 0);
+	comms_setup(&s_comms, loopback_transport(&s_loopback));
+
+	cache_disable();
+	const uint32_t crc_off	 = bench_crc8();
+	const uint32_t comms_off = bench_comms_update();
+
+	cache_enable();
+	// first pass warms the caches up
+	bench_crc8();
+	bench_comms_update();
+	const uint32_t crc_on	= bench_crc8();
+	const uint32_t comms_on = bench_comms_update();
+
+	logger_printf("cache bench, cycles per call (caches off -> on):\n");
+	logger_printf(" crc8 %u B: %lu -> %lu (x%lu.%02lu)\n", BENCH_CRC_LEN, crc_off, crc_on,
+		      crc_off / crc_on, (crc_off * 100 / crc_on) % 100);
+	logger_printf(" comms_update %u packets: %lu -> %lu (x%lu.%02lu)\n", BENCH_PACKETS,
+		      comms_off, comms_on, comms_off / comms_on, (comms_off * 100 / comms_on) % 100);
+}
@@ -1,153 +1,191 @@
+import argparse
+import atexit
+import os
+import re
 import time
-import serial
-import readchar
+import zlib
 import struct
-import sys
-from enum import Enum
 
-serial_dev = "/dev/ttyACM0"
-
-# comms_packet format
-comms_packet_len = 19
-comms_packet_format = "B B 16s B"
-comms_packet_format_crc = "B B 16s"
-
-BOOTLOADER_SIZE = 0x10000
-PACKET_DATA_LEN_MAX = 16
-DEVICE_ID = 0x69
-SYNC_SEQ = [0x11, 0x22, 0x33, 0x44]
+from protocol import (ADDR_BROADCAST, ADDR_REPLY, BUS_BLOCK_LEN, BUS_STATUS_BLOCKS,
+                      CAPTURE_FLAG_BUS, CAPTURE_FLAG_COBS, COBS_DELIMITER, DEVICE_ID,
+                      PACKET_DATA_LEN_MAX, PACKET_LEN_ODD, SYNC_SEQ, SYNC_SEQ_BUS, SYNC_SEQ_COBS,
+                      CaptureSerial, Packet, PacketType, bus_wrap, cobs_decode, cobs_encode,
+                      comms_packet_len, crc8, parse_stream_frame, stream_frame)
 
+serial_dev = "/dev/ttyACM0"
 
-def crc8(data):
-    crc = 0
-    for byte in data:
-        crc ^= byte
-        for _ in range(8):
-            if crc & 0x80:
-                crc = (crc << 1) ^ 0x07
-            else:
-                crc <<= 1
-        crc &= 0xFF  # Ensure crc remains a uint8_t
 
-    return crc
+def read_bootloader_size():
+    # defined once in core/system.h, the firmware builds take it from there as well
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "shared", "inc",
+                        "core", "system.h")
+    with open(path) as f:
+        match = re.search(r"^#define\s+BOOTLOADER_SIZE\s+(0x[0-9A-Fa-f]+|\d+)U?\s*$", f.read(),
+                          re.MULTILINE)
+    if not match:
+        raise Exception("no BOOTLOADER_SIZE in {}".format(path))
+    return int(match.group(1), 0)
+
+
+BOOTLOADER_SIZE = read_bootloader_size()
+
+# struct image_header, see shared/inc/core/image-header.h
+IMAGE_HEADER_OFFSET = 0x400
+IMAGE_HEADER_MAGIC = 0x31474D49
+image_header_format = "<I H H I I I I I"
+# enum image_status
+IMAGE_STATUS_VALID = 1
+
+# enum bl_read_status, see bootloader/src/bootloader.c
+READ_STATUS_OK = 0
+APP_START_ADDRESS = 0x08000000 + BOOTLOADER_SIZE
+# --verify compares one crc32 per range, a mismatch points at the range to read back
+VERIFY_RANGE_LEN = 0x8000
+# readback blocks in flight, more credits are granted every READBACK_WINDOW / 2 blocks
+READBACK_WINDOW = 8
+# bus mode, block status and resend rounds before a node counts as failed
+BUS_REPAIR_ROUNDS = 8
+
+# retransmission timing, RFC 6298 bounds as in the bootloader, seconds
+RTO_INITIAL = 1.0
+RTO_MIN = 0.01
+RTO_MAX = 4.0
+# retransmissions of one exchange before giving up, each waits twice as long
+MAX_RETX = 6
+# replies the device works out first, range crc32s
+WORK_BUDGET = 2.0
+# the first ready follows the erase of the app region, see ERASE_BUDGET_MS
+ERASE_BUDGET = 30.0
+
+# set from the command line, every packet is COBS encoded and 0x00 delimited
+use_cobs = False
+# node every packet goes to in bus mode, None on a point to point link
+bus_address = None
+# bytes read past the last delimiter, start of the next frame
+rx_pending = bytearray()
+
+
+class RttEstimator:
+    """round trip time smoothing of RFC 6298, see shared/inc/core/rtt.h"""
 
+    def __init__(self):
+        self.srtt = None
+        self.rttvar = 0.0
+        self.rto = RTO_INITIAL
+        self.samples = 0
+
+    def sample(self, rtt):
+        """one measured round trip, never one of a retransmitted exchange (Karn)"""
+        if self.srtt is None:
+            self.srtt = rtt
+            self.rttvar = rtt / 2
+        else:
+            self.rttvar = 0.75 * self.rttvar + 0.25 * abs(self.srtt - rtt)
+            self.srtt = 0.875 * self.srtt + 0.125 * rtt
+        self.samples += 1
+        self.rto = min(max(self.srtt + max(0.001, 4 * self.rttvar), RTO_MIN), RTO_MAX)
 
-class Direction(Enum):
-    RX = 1
-    TX = 2
+    def backoff(self):
+        self.rto = min(self.rto * 2, RTO_MAX)
 
+    def __str__(self):
+        if self.srtt is None:
+            return "no rtt samples, rto {:.1f} ms".format(self.rto * 1e3)
+        return "srtt {:.1f} ms, rttvar {:.1f} ms, rto {:.1f} ms, {} samples".format(
+            self.srtt * 1e3, self.rttvar * 1e3, self.rto * 1e3, self.samples)
+
+
+rtt = RttEstimator()
+# last packet received and last one sent, the device may repeat the first or ask for the second
+last_rx = None
+last_tx = None
+# asked the device for its last packet, the next one to arrive is that answer
+probe_pending = False
+# last_rx of the bus nodes not currently addressed
+node_last_rx = {}
+# packets that answered a packet whose ack was lost, acked and waiting to be received
+rx_queue = []
+
+
+def frame_packet(data):
+    if not use_cobs:
+        return data
+    if bus_address is not None:
+        data = bus_wrap(bus_address, data)
+
+    return cobs_encode(data) + bytes([COBS_DELIMITER])
+
+
+def receive_cobs_frame(ser, timeout):
+    global rx_pending
+
+    deadline = time.monotonic() + timeout
+    while True:
+        if COBS_DELIMITER in rx_pending:
+            frame, _, rx_pending = rx_pending.partition(bytes([COBS_DELIMITER]))
+            # back to back delimiters carry no frame
+            if frame:
+                return bytes(frame)
+            continue
+
+        if ser.in_waiting:
+            rx_pending += ser.read(ser.in_waiting)
+        elif time.monotonic() > deadline:
+            raise TimeoutError("timeout on receive frame, {} bytes pending".format(
+                len(rx_pending)))
+        else:
+            time.sleep(0.001)
 
-class PacketType(Enum):
-    data = 0
-    ack = 1
-    retx = 2
-    seq_observed = 3
-    fw_update_req = 4
-    fw_update_res = 5
-    device_id_req = 6
-    device_id_res = 7
-    fw_length_req = 8
-    fw_length_res = 9
-    ready_for_firmware = 10
-    fw_update_successful = 11
-    fw_update_aborted = 12
-    unknown = 13
 
-    def __str__(self):
-        return str(self._name_)
+def receive_body(ser, timeout):
+    """next decoded frame, in bus mode the next reply of bus_address, unwrapped"""
+    while True:
+        raw = cobs_decode(receive_cobs_frame(ser, timeout))
+        if bus_address is None:
+            return raw
+        if len(raw) < 2 or crc8(raw[:-1]) != raw[-1]:
+            raise ValueError("bad bus frame")
+        # our own frames echoed by the line and replies of other nodes
+        if raw[0] == bus_address | ADDR_REPLY:
+            return raw[1:-1]
 
 
-class Packet:
-    def __init__(self):
-        self.dir = Direction.TX
-        self.length = 0
-        self.type = 0
-        self.data = bytes(0xff for _ in range(PACKET_DATA_LEN_MAX))
-        self.crc = 0
-
-    @staticmethod
-    def create_by_type(type: PacketType):
-        packet = Packet()
-        packet.type = type.value
-        return packet
-
-    def set_data(self, data: bytes):
-        if (len(data) > PACKET_DATA_LEN_MAX):
-            raise Exception("Packet data size exceeded")
-
-        self.length = len(data)
-        self.data = data
-
-        if self.length < PACKET_DATA_LEN_MAX:
-            self.data = self.data + \
-                bytes(0xff for _ in range(PACKET_DATA_LEN_MAX - self.length))
-
-    @staticmethod
-    def create_ctrl_packet(type: PacketType):
-        packet = Packet.create_by_type(type)
-        packet.update_crc()
-
-        return packet
-
-    @staticmethod
-    def deserialize(bytes):
-        packet = Packet()
-        unpacked_data = struct.unpack(comms_packet_format, bytes)
-        packet.dir = Direction.RX
-        packet.length = unpacked_data[0]
-        packet.type = unpacked_data[1]
-        packet.data = unpacked_data[2]
-        packet.crc = unpacked_data[3]
-
-        return packet
-
-    def serialize(self):
-        bytes = struct.pack(
-            comms_packet_format,
-            self.length,
-            self.type,
-            self.data,
-            self.crc,
-        )
+def parse_image_header(app_bytes):
+    """(fw_version, image_size, image_crc32) of a stamped app image, None without header"""
+    if len(app_bytes) < IMAGE_HEADER_OFFSET + struct.calcsize(image_header_format):
+        return None
 
-        return bytes
+    (magic, _, _, fw_version, _, image_size, image_crc32, _) = struct.unpack_from(
+        image_header_format, app_bytes, IMAGE_HEADER_OFFSET)
+    if magic != IMAGE_HEADER_MAGIC or image_size != len(app_bytes):
+        return None
 
-    def calculate_crc(self):
-        packed_data = struct.pack(
-            comms_packet_format_crc, self.length, self.type, self.data
-        )
-        return crc8(packed_data)
+    return (fw_version, image_size, image_crc32)
 
-    def update_crc(self):
-        self.crc = self.calculate_crc()
 
-    def log(self):
-        packet_type_str = str(PacketType(self.type))
+def version_str(fw_version):
+    return "{}.{}.{}".format(fw_version >> 16, (fw_version >> 8) & 0xff, fw_version & 0xff)
 
-        # Convert the data field to a hex string for readability
-        data_hex = " ".join(f"{byte:02X}" for byte in self.data)
 
-        # Log the packet
+def installed_image_matches(ser, offered):
+    send_packet(ser, Packet.create_ctrl_packet(PacketType.fw_info_req))
+    info_pkt = receive_packet_of_type(ser, PacketType.fw_info_res)
+    installed = struct.unpack_from("<I I I", info_pkt.data)
+    status = info_pkt.data[12]
 
-        crc_status = "valid"
-        if self.calculate_crc() != self.crc:
-            crc_status = f"invalid, expected: 0x{self.calculate_crc():02X}"
+    if status != IMAGE_STATUS_VALID:
+        print("no valid image installed (status {})".format(status))
+        return False
 
-        direction_str = ""
-        if (self.dir == Direction.RX):
-            direction_str = "<- (RX)"
-        else:
-            direction_str = "-> (TX)"
+    print("installed v{} ({} bytes, crc32 0x{:08X}), offered v{} ({} bytes, crc32 0x{:08X})".format(
+        version_str(installed[0]), installed[1], installed[2],
+        version_str(offered[0]), offered[1], offered[2]))
 
-        print(f"Packet Log: {direction_str}")
-        print(f"  Length: {self.length}")
-        print(f"  Type: {packet_type_str} ({self.type})")
-        print(f"  Data (hex): {data_hex}")
-        print(f"  CRC: 0x{self.crc:02X} - {crc_status}")
+    return installed == offered
 
 
-def receive_packet_of_type(ser, packetType, timeout=2):
-    packet = receive_packet(ser, 5, timeout)
+def receive_packet_of_type(ser, packetType, timeout=None):
+    packet = receive_packet(ser, timeout)
     if packet.type != packetType.value:
         raise Exception(
             "failed to receive ctrl pkt of type: {}".format(str(packetType)))
@@ -155,34 +193,179 @@ def receive_packet_of_type(ser, packetType, timeout=2):
     return packet
 
 
+def receive_device_id_req(ser):
+    """fw_update_res and device_id_req come back to back and a retx repeats only the last
+    packet, a lost fw_update_res is implied by the device_id_req"""
+    packet = receive_packet(ser)
+    if packet.type == PacketType.fw_update_res.value:
+        packet.log()
+        packet = receive_packet(ser)
+    if packet.type != PacketType.device_id_req.value:
+        raise Exception("failed to receive ctrl pkt of type: {}".format(
+            str(PacketType.device_id_req)))
+
+    return packet
+
+
+def write_packet(ser, packet):
+    global last_tx
+
+    last_tx = frame_packet(packet.serialize())
+    ser.write(last_tx)
+
+
+def acknowledges(reply, packet):
+    """acks carry {crc, type} of the packet they acknowledge"""
+    return (reply.type == PacketType.ack.value and reply.data[0] == packet.crc and
+            reply.data[1] == packet.type)
+
+
 def send_packet(ser, packet):
-    #print("sending {} packet".format(str(PacketType(packet.type))))
-    ser.write(packet.serialize())
+    """sends until acked, each wait one RTO, backed off after every timeout
+
+    on a timeout the device is asked for its last packet: the ack of ours or a new reply
+    means ours arrived, the ack of an earlier one or a repeat of last_rx that it was lost
+    """
+    global last_rx
+
+    write_packet(ser, packet)
+    sent = time.monotonic()
+    retransmitted = False
+
+    for _ in range(MAX_RETX + 1):
+        deadline = time.monotonic() + rtt.rto
+        while True:
+            try:
+                reply, answer = receive_one(ser, deadline - time.monotonic())
+            except ValueError as e:
+                print(e)
+                continue
+            if reply is None:
+                break
+
+            if acknowledges(reply, packet):
+                if not retransmitted and not answer:
+                    rtt.sample(time.monotonic() - sent)
+                return
+            if reply.type == PacketType.retx.value:
+                # ours arrived damaged
+                lost = True
+            elif reply.type == PacketType.ack.value:
+                lost = answer
+            else:
+                send_ack_packet(ser, reply)
+                if reply.serialize() != last_rx:
+                    # a reply to ours, only the ack got lost
+                    last_rx = reply.serialize()
+                    rx_queue.append(reply)
+                    return
+                lost = answer
+
+            if lost:
+                write_packet(ser, packet)
+                retransmitted = True
+                deadline = time.monotonic() + rtt.rto
+
+        rtt.backoff()
+        send_retx_packet(ser)
+        retransmitted = True
 
-    if PacketType(packet.type) != PacketType.ack:
-        receive_packet_of_type(ser, PacketType.ack)
+    raise Exception("no ack for {} after {} retransmissions".format(
+        str(PacketType(packet.type)), MAX_RETX))
 
 
-def send_ack_packet(ser):
-    ack_packet = Packet()
-    ack_packet.type = PacketType.ack.value
+def send_ack_packet(ser, packet):
+    ack_packet = Packet.create_by_type(PacketType.ack)
+    ack_packet.data = bytes([packet.crc, packet.type]) + ack_packet.data[2:]
     ack_packet.update_crc()
 
-    send_packet(ser, ack_packet)
+    ser.write(frame_packet(ack_packet.serialize()))
 
 
 def send_retx_packet(ser):
-    ack_packet = Packet()
-    ack_packet.type = PacketType.retx.value
-    ack_packet.update_crc()
+    """asks the device for its last packet"""
+    global probe_pending
+
+    ser.write(frame_packet(Packet.create_ctrl_packet(PacketType.retx).serialize()))
+    probe_pending = True
 
-    send_packet(ser, ack_packet)
 
+def receive_one(ser, timeout):
+    """next packet off the wire and whether it answers a retx probe, None on a timeout,
+    ValueError if it arrived damaged"""
+    global probe_pending
 
-def receive_packet(ser: serial.Serial, crc_invalid_retries=5, timeout=2):
-    if crc_invalid_retries == -1:
-        raise Exception("retry limit reached,aborting")
+    try:
+        if use_cobs:
+            # a lost byte costs only this frame, the next one starts after the delimiter
+            received_data = receive_body(ser, timeout)
+        else:
+            received_data = receive_fixed_packet(ser, timeout)
+    except TimeoutError:
+        return None, False
 
+    answer = probe_pending
+    probe_pending = False
+
+    if len(received_data) != comms_packet_len:
+        raise ValueError("bad frame")
+
+    packet = Packet.deserialize(received_data)
+    if packet.crc != packet.calculate_crc():
+        raise ValueError("invalid CRC")
+
+    return packet, answer
+
+
+def receive_packet(ser, timeout=None):
+    """next new packet of the device, acked
+
+    timeout is the budget of a device busy with our request, one RTO by default, on
+    silence or damage the device is asked for its last packet with backed off RTOs
+    """
+    global last_rx
+
+    if rx_queue:
+        return rx_queue.pop(0)
+
+    wait = rtt.rto if timeout is None else max(timeout, rtt.rto)
+    for _ in range(MAX_RETX + 1):
+        deadline = time.monotonic() + wait
+        timed_out = False
+        while True:
+            try:
+                packet, answer = receive_one(ser, deadline - time.monotonic())
+            except ValueError as e:
+                print(e)
+                break
+            if packet is None:
+                timed_out = True
+                break
+
+            if packet.type == PacketType.ack.value:
+                # late or repeated
+                continue
+            if packet.type == PacketType.retx.value:
+                ser.write(last_tx)
+                continue
+
+            send_ack_packet(ser, packet)
+            # the device had nothing newer when it answered the probe
+            if answer and packet.serialize() == last_rx:
+                continue
+
+            last_rx = packet.serialize()
+            return packet
+
+        if timed_out:
+            rtt.backoff()
+        wait = rtt.rto
+        send_retx_packet(ser)
+
+    raise Exception("device silent after {} retransmissions".format(MAX_RETX))
+
+
+def receive_fixed_packet(ser, timeout):
     timeout_cnt = 0
 
     bytes_to_read = ser.in_waiting
@@ -192,7 +375,7 @@ def receive_packet(ser: serial.Serial, crc_invalid_retries=5, timeout=2):
         timeout_cnt += 0.01
 
         if (timeout_cnt > timeout):
-            raise Exception("timeout on receive packet, in waiting bytes: {} out of {} expected".format(
+            raise TimeoutError("timeout on receive packet, in waiting bytes: {} out of {} expected".format(
                 ser.in_waiting, comms_packet_len))
 
     received_data = ser.read(comms_packet_len)
@@ -203,47 +386,374 @@ def receive_packet(ser: serial.Serial, crc_invalid_retries=5, timeout=2):
             )
         )
 
-    packet = Packet.deserialize(received_data)
+    return received_data
 
-    if packet.crc != packet.calculate_crc():
-        print("invalid CRC")
-        send_retx_packet(ser)
-        return receive_packet(ser, crc_invalid_retries - 1)
 
-    if (PacketType(packet.type) != PacketType.ack):
-        send_ack_packet(ser)
+def range_packet(type: PacketType, address, length):
+    packet = Packet.create_by_type(type)
+    packet.set_data(struct.pack("<I I", address, length))
+    packet.update_crc()
 
     return packet
 
 
+def device_crc32(ser, address, length):
+    send_packet(ser, range_packet(PacketType.crc_req, address, length))
+    crc_pkt = receive_packet_of_type(ser, PacketType.crc_res, WORK_BUDGET)
+    if crc_pkt.data[0] != READ_STATUS_OK:
+        raise Exception("crc_req of 0x{:08X}+{} refused, status {}".format(
+            address, length, crc_pkt.data[0]))
+
+    return struct.unpack_from("<I", crc_pkt.data, 1)[0]
+
+
+def print_throughput(what, length, elapsed):
+    print("{} {} bytes in {:.2f} s, {:.4f} MB/s".format(
+        what, length, elapsed, length / elapsed / 1e6))
+
+
+def verify(ser, app_bytes):
+    """compares per range crc32s, only 8 bytes out and 5 back per range"""
+    start = time.monotonic()
+    mismatches = []
+    for offset in range(0, len(app_bytes), VERIFY_RANGE_LEN):
+        chunk = app_bytes[offset:offset + VERIFY_RANGE_LEN]
+        if device_crc32(ser, APP_START_ADDRESS + offset, len(chunk)) != zlib.crc32(chunk):
+            mismatches.append(offset)
+    print_throughput("verified", len(app_bytes), time.monotonic() - start)
+
+    for offset in mismatches:
+        print("mismatch in 0x{:08X}..0x{:08X}".format(
+            APP_START_ADDRESS + offset,
+            APP_START_ADDRESS + min(offset + VERIFY_RANGE_LEN, len(app_bytes))))
+
+    return not mismatches
+
+
+def drain(ser, quiet=0.2):
+    """drops everything until the line was silent for quiet seconds"""
+    global rx_pending
+
+    last = time.monotonic()
+    while time.monotonic() - last < quiet:
+        if ser.in_waiting:
+            ser.read(ser.in_waiting)
+            last = time.monotonic()
+        else:
+            time.sleep(0.01)
+    rx_pending = bytearray()
+
+
+def send_ready(ser, credits):
+    ready = Packet.create_by_type(PacketType.ready_for_firmware)
+    ready.set_data(bytes([credits]))
+    ready.update_crc()
+    # acked like any packet, the ack is picked up among the blocks
+    ser.write(frame_packet(ready.serialize()))
+
+    return ready
+
+
+def readback_range(ser, address, length, out):
+    """streams the range into out, returns False on a lost or corrupt block"""
+    send_packet(ser, range_packet(PacketType.read_req, address, length))
+    res = receive_packet_of_type(ser, PacketType.read_res, WORK_BUDGET)
+    if res.data[0] != READ_STATUS_OK:
+        raise Exception("read_req of 0x{:08X}+{} refused, status {}".format(
+            address, length, res.data[0]))
+    range_crc, seq = struct.unpack_from("<I I", res.data, 1)
+
+    received = bytearray()
+    last_ready = send_ready(ser, READBACK_WINDOW)
+    since_ready = 0
+    while len(received) < length:
+        try:
+            # blocks follow each other, a gap of an RTO means the rest of the window is lost
+            frame = receive_cobs_frame(ser, rtt.rto)
+        except TimeoutError:
+            return False
+        try:
+            block_seq, payload = parse_stream_frame(frame)
+        except ValueError:
+            try:
+                packet = Packet.deserialize(cobs_decode(frame))
+            except (ValueError, struct.error):
+                return False
+            if packet.type == PacketType.retx.value:
+                ser.write(frame_packet(last_ready.serialize()))
+            continue
+
+        if block_seq != seq:
+            return False
+        seq = (seq + 1) & 0xFFFFFFFF
+        received += payload
+        out += payload
+
+        since_ready += 1
+        if since_ready == READBACK_WINDOW // 2 and len(received) < length:
+            last_ready = send_ready(ser, since_ready)
+            since_ready = 0
+
+    if zlib.crc32(received) != range_crc:
+        raise Exception("readback of 0x{:08X}+{} does not match the device crc32".format(
+            address, length))
+
+    return True
+
+
+def readback(ser, address, length, path):
+    out = bytearray()
+    start = time.monotonic()
+    while len(out) < length:
+        done = len(out)
+        if not readback_range(ser, address + done, length - done, out):
+            # keep the blocks that made it, ask again from the first missing one
+            print("lost a block at 0x{:08X}, restarting from there".format(address + len(out)))
+            drain(ser)
+    print_throughput("read back", length, time.monotonic() - start)
+
+    with open(path, "wb") as f:
+        f.write(out)
+
+
+def select_node(address):
+    """last_rx is per node, a node repeats its own last packet when asked"""
+    global bus_address, last_rx, probe_pending
+
+    if address != bus_address:
+        node_last_rx[bus_address] = last_rx
+        last_rx = node_last_rx.get(address)
+        probe_pending = False
+    bus_address = address
+
+
+def send_block(ser, address, app_bytes, index):
+    """one block as a stream frame, never acked, broadcast or unicast repair"""
+    payload = app_bytes[index * BUS_BLOCK_LEN:(index + 1) * BUS_BLOCK_LEN]
+    frame = bus_wrap(address, stream_frame(index, payload))
+    ser.write(cobs_encode(frame) + bytes([COBS_DELIMITER]))
+
+
+def device_uid(packet):
+    """unique ID of the device, device_id_req carries it"""
+    return packet.data[:packet.length].hex()
+
+
+def other_uid(ser, uid):
+    """unique ID of a second node answering to the selected address, None if none did
+
+    every node on the address answers fw_update_req, the device_id_req of the others
+    follow the first within an RTO
+    """
+    deadline = time.monotonic() + rtt.rto
+    while True:
+        try:
+            packet, _ = receive_one(ser, deadline - time.monotonic())
+        except ValueError as e:
+            print(e)
+            continue
+        if packet is None:
+            return None
+        if packet.type == PacketType.device_id_req.value and device_uid(packet) != uid:
+            return device_uid(packet)
+
+
+def bus_prepare_node(ser, address, app_size):
+    """unicast handshake up to the erase, the node then waits for the broadcast, False if
+    more than one node answers to the address"""
+    select_node(address)
+
+    send_packet(ser, Packet.create_ctrl_packet(PacketType.fw_update_req))
+    uid = device_uid(receive_device_id_req(ser))
+    other = other_uid(ser, uid)
+    if other is not None:
+        print("node 0x{:02X}: unique IDs {} and {} share the address, build with BUS_ADDRESS"
+              .format(address, uid, other))
+        return False
+    print("node 0x{:02X}: unique ID {}".format(address, uid))
+
+    device_id_res_pkt = Packet.create_by_type(PacketType.device_id_res)
+    device_id_res_pkt.set_data(bytes([DEVICE_ID,]))
+    device_id_res_pkt.update_crc()
+    send_packet(ser, device_id_res_pkt)
+
+    receive_packet_of_type(ser, PacketType.fw_length_req)
+    fw_length_res = Packet.create_by_type(PacketType.fw_length_res)
+    fw_length_res.set_data(app_size.to_bytes(4, 'little'))
+    fw_length_res.update_crc()
+    send_packet(ser, fw_length_res)
+
+    # sent once the app region is erased, that takes a while
+    receive_packet_of_type(ser, PacketType.ready_for_firmware, ERASE_BUDGET)
+    return True
+
+
+def bus_missing_blocks(ser, address):
+    """block indices the node still misses, one block_status_req per run of gaps"""
+    select_node(address)
+
+    missing = []
+    start = 0
+    while True:
+        req = Packet.create_by_type(PacketType.block_status_req)
+        req.set_data(start.to_bytes(4, 'little'))
+        req.update_crc()
+        send_packet(ser, req)
+
+        res = receive_packet_of_type(ser, PacketType.block_status_res)
+        count, first = struct.unpack_from("<I I", res.data)
+        bitmap = res.data[8:8 + BUS_STATUS_BLOCKS // 8]
+        missing += [first + i for i in range(BUS_STATUS_BLOCKS) if bitmap[i // 8] >> (i % 8) & 1]
+
+        if len(missing) >= count:
+            return missing
+        start = first + BUS_STATUS_BLOCKS
+
+
+def bus_update(ser, nodes, app_bytes):
+    """image broadcast once, gaps repaired per node, returns the nodes that did not finish"""
+    block_cnt = (len(app_bytes) + BUS_BLOCK_LEN - 1) // BUS_BLOCK_LEN
+
+    prepared = []
+    failed = []
+    for address in nodes:
+        print("preparing node 0x{:02X}".format(address))
+        (prepared if bus_prepare_node(ser, address, len(app_bytes)) else failed).append(address)
+
+    start = time.monotonic()
+    for index in range(block_cnt):
+        send_block(ser, ADDR_BROADCAST, app_bytes, index)
+    print_throughput("broadcast", len(app_bytes), time.monotonic() - start)
+
+    for address in prepared:
+        repaired = 0
+        for _ in range(BUS_REPAIR_ROUNDS):
+            missing = bus_missing_blocks(ser, address)
+            if not missing:
+                break
+            for index in missing:
+                send_block(ser, address, app_bytes, index)
+            repaired += len(missing)
+        else:
+            missing = bus_missing_blocks(ser, address)
+
+        if missing:
+            print("node 0x{:02X}: {} blocks still missing, not committed".format(
+                address, len(missing)))
+            failed.append(address)
+            continue
+
+        select_node(address)
+        send_packet(ser, Packet.create_ctrl_packet(PacketType.fw_update_successful))
+        print("node 0x{:02X}: done, {} of {} blocks repaired".format(address, repaired, block_cnt))
+
+    return failed
+
+
 def main():
+    global use_cobs
+
+    parser = argparse.ArgumentParser(description="firmware updater")
+    parser.add_argument("image", nargs="?", help="full image, bootloader included")
+    parser.add_argument("--port", default=serial_dev, help="serial device")
+    parser.add_argument("--cobs", action="store_true",
+                        help="COBS delimited framing, resyncs after lost bytes")
+    parser.add_argument("--force", action="store_true",
+                        help="flash even if the device already runs this image")
+    parser.add_argument("--rtscts", action="store_true",
+                        help="RTS/CTS flow control, bootloader built with UART_FLOW_CONTROL=1")
+    parser.add_argument("--verify", action="store_true",
+                        help="compare the installed app with the image by range crc32s, no flashing")
+    parser.add_argument("--readback", metavar="FILE",
+                        help="read the app region back into FILE, no flashing")
+    parser.add_argument("--address", type=lambda x: int(x, 0), default=APP_START_ADDRESS,
+                        help="start of --readback")
+    parser.add_argument("--length", type=lambda x: int(x, 0),
+                        help="length of --readback, defaults to the image app size")
+    parser.add_argument("--bus", metavar="ADDR,...",
+                        type=lambda x: [int(a, 0) for a in x.split(",")],
+                        help="multicast update of these node addresses on a shared bus")
+    parser.add_argument("--capture", metavar="FILE",
+                        help="record every frame with timestamps, see capture.py")
+    args = parser.parse_args()
+    # readback blocks are stream frames, which exist with COBS framing only
+    use_cobs = args.cobs or args.readback is not None or args.bus is not None
+
+    if args.image is None and (args.readback is None or args.length is None):
+        parser.error("an image is required, except for --readback with --length")
+
+    # bus_sim and capture.py import this module for the session logic, without a port
+    import serial
+
     # no need to close it as OS will do it
     ser = serial.Serial(
-        port=serial_dev,
+        port=args.port,
         baudrate=115200,
         parity=serial.PARITY_NONE,
         stopbits=serial.STOPBITS_ONE,
         bytesize=serial.EIGHTBITS,
+        rtscts=args.rtscts,
     )
 
     if not ser.is_open:
-        print("failed to open serial port {}".format(serial_dev))
+        print("failed to open serial port {}".format(args.port))
         exit(1)
 
-    print("{} opened successfuly".format(serial_dev))
+    print("{} opened successfuly".format(args.port))
+
+    if args.capture is not None:
+        flags = (CAPTURE_FLAG_COBS if use_cobs else 0) | (CAPTURE_FLAG_BUS if args.bus else 0)
+        capture_file = open(args.capture, "wb")
+        # closed on exit() and on exceptions alike, the tail of a failed session matters most
+        atexit.register(capture_file.close)
+        ser = CaptureSerial(ser, capture_file, flags)
 
-    ser.write(bytes(SYNC_SEQ))
+    image_bytes = bytes()
+    if args.image is not None:
+        with open(args.image, "rb") as f:
+            image_bytes = f.read()
+
+    # skip bootloader bytes, we will send only actual APP
+    app_bytes = image_bytes[BOOTLOADER_SIZE:]
+    app_size = len(app_bytes)
+    app_header = parse_image_header(app_bytes)
+    if app_header is None and args.image is not None:
+        print("image has no header, the installed version cannot be compared")
+
+    if args.bus is not None:
+        # nobody answers the sync on a bus, the nodes wait to be addressed
+        ser.write(bytes(SYNC_SEQ_BUS))
+        time.sleep(0.1)
+        failed = bus_update(ser, args.bus, app_bytes)
+        exit(1 if failed else 0)
+
+    ser.write(bytes(SYNC_SEQ_COBS if use_cobs else SYNC_SEQ))
 
     seq_observed_pkt = receive_packet_of_type(ser, PacketType.seq_observed)
     seq_observed_pkt.log()
 
+    if args.verify or args.readback is not None:
+        ok = True
+        if args.verify:
+            ok = verify(ser, app_bytes)
+            print("installed app {}".format("matches the image" if ok else "differs"))
+        if args.readback is not None:
+            readback(ser, args.address, args.length if args.length is not None else app_size,
+                     args.readback)
+        # nothing was written, let the device boot what it has
+        send_packet(ser, Packet.create_ctrl_packet(PacketType.fw_update_aborted))
+        exit(0 if ok else 1)
+
+    if app_header is not None and not args.force and installed_image_matches(ser, app_header):
+        print("device is up to date, skipping")
+        send_packet(ser, Packet.create_ctrl_packet(PacketType.fw_update_aborted))
+        return
+
     fw_update_req_pkt = Packet.create_ctrl_packet(PacketType.fw_update_req)
     fw_update_req_pkt.log()
     send_packet(ser, fw_update_req_pkt)
 
-    fw_update_res_pkt = receive_packet_of_type(ser, PacketType.fw_update_res)
-    fw_update_res_pkt.log()
-    device_id_req_pkt = receive_packet_of_type(ser, PacketType.device_id_req)
+    device_id_req_pkt = receive_device_id_req(ser)
     device_id_req_pkt.log()
 
     device_id_res_pkt = Packet.create_by_type(PacketType.device_id_res)
@@ -254,14 +764,6 @@ def main():
     fw_length_req_pkt = receive_packet_of_type(ser, PacketType.fw_length_req)
     fw_length_req_pkt.log()
 
-    image_bytes = bytes()
-    with open(sys.argv[1], "rb") as f:
-        image_bytes = f.read()
-
-    # skip bootloader bytes, we will send only actual APP
-    app_bytes = image_bytes[BOOTLOADER_SIZE:]
-    app_size = len(app_bytes)
-
     fw_length_res = Packet.create_by_type(PacketType.fw_length_res)
     fw_length_res.set_data(app_size.to_bytes(4, 'little'))
     fw_length_res.update_crc()
@@ -269,11 +771,15 @@ def main():
 
     bytes_sent = 0
     data_packet = Packet.create_by_type(PacketType.data)
-    
+    # the first ready comes once the app region is erased
+    ready_timeout = ERASE_BUDGET
 
     while bytes_sent < app_size:
-        fw_length_req_pkt = receive_packet_of_type(
-            ser, PacketType.ready_for_firmware, 15)
+        ready_pkt = receive_packet_of_type(
+            ser, PacketType.ready_for_firmware, ready_timeout)
+        ready_timeout = None
+        # the device names the offset it wants, the one it already has after a lost packet
+        bytes_sent = struct.unpack_from("<I", ready_pkt.data)[0]
 
         packet_data_len = PACKET_DATA_LEN_MAX
         bytes_left = app_size - bytes_sent
@@ -282,12 +788,16 @@ def main():
             packet_data_len = bytes_left
 
         data_packet.set_data(app_bytes[bytes_sent:bytes_sent+packet_data_len])
+        if (bytes_sent // PACKET_DATA_LEN_MAX) % 2:
+            data_packet.length |= PACKET_LEN_ODD
         data_packet.update_crc()
         send_packet(ser, data_packet)
 
         bytes_sent = bytes_sent + packet_data_len
         print("sent {} bytes out of {}".format(bytes_sent, app_size))
 
+    print(rtt)
+
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,195 @@
+"""multicast update against simulated nodes on a shared virtual bus
+
+the nodes follow the bootloader bus mode, see bl_state_step_bus_receive in
+bootloader/src/bootloader.c, and lose broadcast blocks at the given rate,
+unicast packets in either direction at the control loss rate
+"""
+import argparse
+import random
+
+import base
+from protocol import (ADDR_BROADCAST, ADDR_REPLY, BUS_BLOCK_LEN, BUS_STATUS_BLOCKS,
+                      COBS_DELIMITER, DEVICE_ID, Packet, PacketType, bus_wrap, cobs_decode,
+                      cobs_encode, comms_packet_len, crc8, parse_stream_body)
+
+
+class SimNode:
+    def __init__(self, address, loss, ctrl_loss, rng):
+        self.address = address
+        self.loss = loss
+        self.ctrl_loss = ctrl_loss
+        self.rng = rng
+        self.uid = bytes(rng.randrange(256) for _ in range(12))
+        self.rx = bytearray()
+        # comms answers a retx before anything was sent with an ack of nothing
+        self.last_reply = Packet.create_ctrl_packet(PacketType.ack).serialize()
+        self.fw_length = 0
+        self.flash = bytearray()
+        self.received = set()
+        self.committed = False
+        self.lost = 0
+
+    def block_cnt(self):
+        return (self.fw_length + BUS_BLOCK_LEN - 1) // BUS_BLOCK_LEN
+
+    def on_bytes(self, data, bus):
+        self.rx += data
+        while COBS_DELIMITER in self.rx:
+            frame, _, self.rx = self.rx.partition(bytes([COBS_DELIMITER]))
+            if frame:
+                self.on_frame(bytes(frame), bus)
+
+    def on_frame(self, frame, bus):
+        try:
+            raw = cobs_decode(frame)
+        except ValueError:
+            return
+        if len(raw) < 2 or crc8(raw[:-1]) != raw[-1]:
+            return
+        # replies of other nodes carry ADDR_REPLY and never match
+        if raw[0] not in (self.address, ADDR_BROADCAST):
+            return
+        broadcast = raw[0] == ADDR_BROADCAST
+        body = raw[1:-1]
+
+        if len(body) > 1 and body[1] == PacketType.stream.value:
+            if broadcast and self.rng.random() < self.loss:
+                self.lost += 1
+                return
+            self.take_block(*parse_stream_body(body))
+            return
+        if len(body) != comms_packet_len:
+            return
+        if not broadcast and self.rng.random() < self.ctrl_loss:
+            return
+
+        packet = Packet.deserialize(body)
+        if packet.crc != packet.calculate_crc() or packet.type == PacketType.ack.value:
+            return
+        if packet.type == PacketType.retx.value:
+            bus.reply(self, self.last_reply)
+            return
+        if not broadcast:
+            # acks name the packet they acknowledge, {crc, type}
+            ack = Packet.create_by_type(PacketType.ack)
+            ack.data = bytes([packet.crc, packet.type]) + ack.data[2:]
+            ack.update_crc()
+            self.last_reply = ack.serialize()
+            self.reply(bus, self.last_reply)
+        self.handle(packet, bus)
+
+    def reply(self, bus, body):
+        if self.rng.random() >= self.ctrl_loss:
+            bus.reply(self, body)
+
+    def send(self, bus, type, data=None):
+        packet = Packet.create_by_type(type)
+        if data is not None:
+            packet.set_data(data)
+        packet.update_crc()
+        self.last_reply = packet.serialize()
+        self.reply(bus, self.last_reply)
+
+    def handle(self, packet, bus):
+        if packet.type == PacketType.fw_update_req.value:
+            self.send(bus, PacketType.fw_update_res)
+            self.send(bus, PacketType.device_id_req, self.uid)
+        elif packet.type == PacketType.device_id_res.value:
+            assert packet.data[0] == DEVICE_ID
+            self.send(bus, PacketType.fw_length_req)
+        elif packet.type == PacketType.fw_length_res.value:
+            self.fw_length = int.from_bytes(packet.data[:4], 'little')
+            self.flash = bytearray(b"\xff" * self.fw_length)
+            self.send(bus, PacketType.ready_for_firmware)
+        elif packet.type == PacketType.block_status_req.value:
+            start = int.from_bytes(packet.data[:4], 'little')
+            missing = [i for i in range(self.block_cnt()) if i not in self.received]
+            first = next((i for i in missing if i >= start), self.block_cnt())
+            bitmap = bytearray(BUS_STATUS_BLOCKS // 8)
+            for i in range(BUS_STATUS_BLOCKS):
+                if first + i < self.block_cnt() and first + i not in self.received:
+                    bitmap[i // 8] |= 1 << (i % 8)
+            self.send(bus, PacketType.block_status_res,
+                      len(missing).to_bytes(4, 'little') + first.to_bytes(4, 'little') +
+                      bytes(bitmap))
+        elif packet.type == PacketType.fw_update_successful.value:
+            self.committed = len(self.received) == self.block_cnt()
+
+    def take_block(self, index, payload):
+        if index >= self.block_cnt() or index in self.received:
+            return
+        offset = index * BUS_BLOCK_LEN
+        self.flash[offset:offset + len(payload)] = payload
+        self.received.add(index)
+
+
+class VirtualBus:
+    """what the host writes reaches every node, what a node writes every other one and the host"""
+
+    def __init__(self, nodes):
+        self.nodes = nodes
+        self.host_rx = bytearray()
+
+    @property
+    def in_waiting(self):
+        return len(self.host_rx)
+
+    def read(self, size):
+        data = bytes(self.host_rx[:size])
+        del self.host_rx[:size]
+        return data
+
+    def write(self, data):
+        for node in self.nodes:
+            node.on_bytes(data, self)
+
+    def reply(self, sender, body):
+        frame = cobs_encode(bus_wrap(sender.address | ADDR_REPLY, body)) + bytes([COBS_DELIMITER])
+        self.host_rx += frame
+        for node in self.nodes:
+            if node is not sender:
+                node.on_bytes(frame, self)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--nodes", type=int, default=4)
+    parser.add_argument("--loss", type=float, default=0.05, help="broadcast block loss rate")
+    parser.add_argument("--ctrl-loss", type=float, default=0.0,
+                        help="unicast packet loss rate, each direction")
+    parser.add_argument("--size", type=int, default=64 * 1024, help="app image size")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--collide", action="store_true",
+                        help="one more node on the address of the first, both must be skipped")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    app_bytes = bytes(rng.randrange(256) for _ in range(args.size))
+    nodes = [SimNode(address, args.loss, args.ctrl_loss, rng)
+             for address in range(1, args.nodes + 1)]
+    addresses = [node.address for node in nodes]
+    if args.collide:
+        nodes.append(SimNode(nodes[0].address, args.loss, args.ctrl_loss, rng))
+    bus = VirtualBus(nodes)
+
+    base.use_cobs = True
+    failed = base.bus_update(bus, addresses, app_bytes)
+    print(base.rtt)
+
+    if args.collide:
+        ok = failed == [nodes[0].address] and not any(
+            node.committed for node in nodes if node.address == nodes[0].address)
+        nodes = [node for node in nodes if node.address != nodes[0].address]
+    else:
+        ok = not failed
+    for node in nodes:
+        match = node.committed and bytes(node.flash) == app_bytes
+        print("node 0x{:02X}: {} broadcast blocks lost, image {}".format(
+            node.address, node.lost, "ok" if match else "WRONG"))
+        ok = ok and match
+
+    exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,362 @@
+"""decode, analyse and replay session captures of base.py --capture
+
+decode   one line per frame, packet types by name
+stats    time per phase, ack latency per packet type, retransmissions
+replay   writes the TX side again with the original timing, to a port or the bus
+         simulator, and analyses what comes back
+"""
+import argparse
+import io
+import random
+import statistics
+import time
+
+try:
+    import serial
+except ImportError:
+    # replaying to a port needs it, decoding does not
+    serial = None
+
+from protocol import (ADDR_BROADCAST, ADDR_REPLY, CAPTURE_FLAG_BUS, CAPTURE_FLAG_COBS,
+                      CAPTURE_RX, CAPTURE_TX, COBS_DELIMITER, SYNC_SEQ, SYNC_SEQ_BUS,
+                      SYNC_SEQ_COBS, CaptureSerial, Packet, PacketType, cobs_decode,
+                      comms_packet_len, crc8, parse_capture, parse_stream_body, read_capture)
+
+SYNC_SEQS = {bytes(SYNC_SEQ), bytes(SYNC_SEQ_COBS), bytes(SYNC_SEQ_BUS)}
+
+# packets that start a phase, the time until the next one is accounted to it
+PHASE_MARKERS = {
+    (CAPTURE_TX, PacketType.fw_info_req): "info",
+    (CAPTURE_TX, PacketType.fw_update_req): "handshake",
+    (CAPTURE_TX, PacketType.fw_length_res): "erase",
+    (CAPTURE_RX, PacketType.ready_for_firmware): "transfer",
+    (CAPTURE_TX, PacketType.crc_req): "verify",
+    (CAPTURE_TX, PacketType.read_req): "readback",
+    (CAPTURE_TX, PacketType.block_status_req): "repair",
+    (CAPTURE_TX, PacketType.fw_update_successful): "commit",
+    (CAPTURE_TX, PacketType.fw_update_aborted): "commit",
+}
+
+
+def packet_type(value):
+    return PacketType(value) if value < PacketType.unknown.value else PacketType.unknown
+
+
+class Frame:
+    def __init__(self, t_us, direction, address=None):
+        self.t_us = t_us
+        self.direction = direction
+        self.address = address
+        self.packet = None
+        self.stream = None  # (seq, payload length)
+        self.sync = None
+        self.bad = None
+
+    def kind(self):
+        if self.sync is not None:
+            return "sync"
+        if self.bad is not None:
+            return "bad"
+        if self.stream is not None:
+            return "stream"
+        return str(packet_type(self.packet.type))
+
+    def __str__(self):
+        arrow = "->" if self.direction == CAPTURE_TX else "<-"
+        where = "" if self.address is None else " 0x{:02X}".format(self.address)
+        line = "{:12.3f} ms {}{} {}".format(self.t_us / 1000, arrow, where, self.kind())
+        if self.sync is not None:
+            return line + " " + self.sync.hex(" ")
+        if self.bad is not None:
+            return line + " ({})".format(self.bad)
+        if self.stream is not None:
+            return line + " seq {} len {}".format(*self.stream)
+        return line + " len {} data {} crc 0x{:02X}".format(
+            self.packet.length, self.packet.data.hex(" "), self.packet.crc)
+
+
+def parse_body(frame, body):
+    if len(body) > 1 and body[1] == PacketType.stream.value:
+        try:
+            seq, payload = parse_stream_body(body)
+            frame.stream = (seq, len(payload))
+        except ValueError as e:
+            frame.bad = str(e)
+        return frame
+
+    if len(body) != comms_packet_len:
+        frame.bad = "{} bytes".format(len(body))
+        return frame
+
+    packet = Packet.deserialize(body)
+    if packet.crc != packet.calculate_crc():
+        frame.bad = "invalid CRC"
+    else:
+        frame.packet = packet
+    return frame
+
+
+def parse_cobs(t_us, direction, raw, bus):
+    try:
+        body = cobs_decode(raw)
+    except ValueError:
+        frame = Frame(t_us, direction)
+        frame.bad = "COBS"
+        return frame
+
+    if not bus:
+        return parse_body(Frame(t_us, direction), body)
+
+    if len(body) < 2 or crc8(body[:-1]) != body[-1]:
+        frame = Frame(t_us, direction)
+        frame.bad = "bus crc"
+        return frame
+
+    return parse_body(Frame(t_us, direction, body[0] & ~ADDR_REPLY), body[1:-1])
+
+
+def frames(flags, records):
+    """records split into frames, each stamped with the time its last byte was seen"""
+    cobs = flags & CAPTURE_FLAG_COBS
+    bus = flags & CAPTURE_FLAG_BUS
+    pending = {CAPTURE_TX: bytearray(), CAPTURE_RX: bytearray()}
+    out = []
+
+    for t_us, direction, data in records:
+        if direction == CAPTURE_TX and data in SYNC_SEQS:
+            frame = Frame(t_us, direction)
+            frame.sync = data
+            out.append(frame)
+            continue
+
+        buf = pending[direction]
+        buf += data
+        if cobs:
+            while COBS_DELIMITER in buf:
+                raw, _, rest = bytes(buf).partition(bytes([COBS_DELIMITER]))
+                buf[:] = rest
+                if raw:
+                    out.append(parse_cobs(t_us, direction, raw, bus))
+        else:
+            while len(buf) >= comms_packet_len:
+                out.append(parse_body(Frame(t_us, direction), bytes(buf[:comms_packet_len])))
+                del buf[:comms_packet_len]
+
+    return out
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def latency_line(name, values_ms):
+    return "  {:28} {:6} {:9.2f} {:9.2f} {:9.2f} {:9.2f}".format(
+        name, len(values_ms), min(values_ms), statistics.median(values_ms),
+        percentile(values_ms, 0.95), max(values_ms))
+
+
+def phase_table(all_frames):
+    phases = {}
+    order = []
+    phase = "sync"
+    since = all_frames[0].t_us if all_frames else 0
+
+    for frame in all_frames:
+        marker = None
+        if frame.packet is not None:
+            marker = PHASE_MARKERS.get((frame.direction, packet_type(frame.packet.type)))
+        elif frame.stream is not None and frame.direction == CAPTURE_TX and \
+                frame.address == ADDR_BROADCAST:
+            marker = "broadcast"
+        # readies keep coming during the transfer, only the first one starts it
+        if marker == "transfer" and phase != "erase":
+            marker = None
+
+        if marker is not None and marker != phase:
+            if phase not in phases:
+                order.append(phase)
+                phases[phase] = [0, 0, 0]
+            phases[phase][0] += frame.t_us - since
+            phase = marker
+            since = frame.t_us
+
+        if phase not in phases:
+            order.append(phase)
+            phases[phase] = [0, 0, 0]
+        phases[phase][1 if frame.direction == CAPTURE_TX else 2] += 1
+
+    if all_frames:
+        phases[phase][0] += all_frames[-1].t_us - since
+
+    return [(name, *phases[name]) for name in order if phases[name][1] + phases[name][2] > 0]
+
+
+def print_stats(all_frames):
+    if not all_frames:
+        print("empty capture")
+        return
+
+    print("{} frames over {:.3f} s".format(
+        len(all_frames), (all_frames[-1].t_us - all_frames[0].t_us) / 1e6))
+
+    print("phases:")
+    print("  {:22} {:>10} {:>8} {:>8}".format("", "ms", "tx", "rx"))
+    for name, duration_us, tx, rx in phase_table(all_frames):
+        print("  {:22} {:10.1f} {:8} {:8}".format(name, duration_us / 1000, tx, rx))
+
+    # acks name the packet they acknowledge by {crc, type}
+    acks = {}
+    host_turnaround = []
+    waiting = {}
+    last_ready = None
+    for frame in all_frames:
+        packet = frame.packet
+        if packet is None:
+            continue
+        key = (frame.address, packet.crc, packet.type)
+        if frame.direction == CAPTURE_TX:
+            if packet.type == PacketType.data.value and last_ready is not None:
+                host_turnaround.append((frame.t_us - last_ready) / 1000)
+                last_ready = None
+            if packet.type not in (PacketType.ack.value, PacketType.retx.value):
+                # a resent packet is timed from its last copy
+                waiting[key] = frame.t_us
+        else:
+            if packet.type == PacketType.ack.value:
+                acked = (frame.address, packet.data[0], packet.data[1])
+                if acked in waiting:
+                    acks.setdefault(packet_type(acked[2]), []).append(
+                        (frame.t_us - waiting.pop(acked)) / 1000)
+            elif packet.type == PacketType.ready_for_firmware.value:
+                last_ready = frame.t_us
+
+    print("latency, ms:")
+    print("  {:28} {:>6} {:>9} {:>9} {:>9} {:>9}".format(
+        "", "n", "min", "median", "p95", "max"))
+    for acked_type, values in sorted(acks.items(), key=lambda item: item[0].value):
+        print(latency_line("ack of " + str(acked_type), values))
+    if host_turnaround:
+        print(latency_line("ready to data", host_turnaround))
+    if waiting:
+        print("  {} packets never acked".format(len(waiting)))
+
+    counts = {}
+    seen = set()
+    resent = 0
+    bad = {CAPTURE_TX: 0, CAPTURE_RX: 0}
+    for frame in all_frames:
+        if frame.bad is not None:
+            bad[frame.direction] += 1
+        if frame.packet is None:
+            continue
+        name = (frame.direction, str(packet_type(frame.packet.type)))
+        counts[name] = counts.get(name, 0) + 1
+        if frame.direction == CAPTURE_TX and frame.packet.type != PacketType.ack.value:
+            key = (frame.address, frame.packet.serialize())
+            resent += key in seen and frame.packet.type != PacketType.retx.value
+            seen.add(key)
+
+    print("retransmissions:")
+    print("  host retx requests     {:6}".format(counts.get((CAPTURE_TX, "retx"), 0)))
+    print("  device retx requests   {:6}".format(counts.get((CAPTURE_RX, "retx"), 0)))
+    print("  packets sent again     {:6}".format(resent))
+    print("  bad frames tx / rx     {:6} / {}".format(bad[CAPTURE_TX], bad[CAPTURE_RX]))
+
+    print("packets:")
+    for (direction, name), count in sorted(counts.items()):
+        print("  {} {:20} {:6}".format("->" if direction == CAPTURE_TX else "<-", name, count))
+
+
+def replay(records, ser, speed, tail):
+    """TX records at their original offsets, open loop, replies are only recorded"""
+    start = time.perf_counter()
+    for t_us, direction, data in records:
+        if direction != CAPTURE_TX:
+            continue
+        while time.perf_counter() - start < t_us / 1e6 / speed:
+            if ser.in_waiting:
+                ser.read(ser.in_waiting)
+            else:
+                time.sleep(0.0005)
+        ser.write(data)
+        # replies are stamped when read, the simulator answers within the write
+        if ser.in_waiting:
+            ser.read(ser.in_waiting)
+
+    end = time.perf_counter() + tail
+    while time.perf_counter() < end:
+        if ser.in_waiting:
+            ser.read(ser.in_waiting)
+        else:
+            time.sleep(0.001)
+
+
+def simulated_bus(all_frames):
+    """bus_sim nodes for every address the capture talks to, lossless"""
+    import bus_sim
+
+    addresses = sorted({frame.address for frame in all_frames
+                        if frame.direction == CAPTURE_TX and frame.address is not None and
+                        frame.address != ADDR_BROADCAST})
+    rng = random.Random(1)
+    return bus_sim.VirtualBus([bus_sim.SimNode(address, 0.0, 0.0, rng)
+                               for address in addresses])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    sub.add_parser("decode").add_argument("capture")
+    sub.add_parser("stats").add_argument("capture")
+    rp = sub.add_parser("replay")
+    rp.add_argument("capture")
+    target = rp.add_mutually_exclusive_group(required=True)
+    target.add_argument("--port", help="serial device of a bootloader waiting for sync")
+    target.add_argument("--sim", action="store_true",
+                        help="bus_sim nodes, bus mode captures only")
+    rp.add_argument("--baud", type=int, default=115200)
+    rp.add_argument("--speed", type=float, default=1.0, help="2 replays twice as fast")
+    rp.add_argument("--tail", type=float, default=1.0,
+                    help="seconds to keep recording after the last TX frame")
+    rp.add_argument("--out", help="capture of the replay, analysed either way")
+    args = parser.parse_args()
+
+    flags, records = read_capture(args.capture)
+    all_frames = frames(flags, records)
+
+    if args.command == "decode":
+        for frame in all_frames:
+            print(frame)
+        return
+    if args.command == "stats":
+        print_stats(all_frames)
+        return
+
+    if args.sim:
+        if not flags & CAPTURE_FLAG_BUS:
+            parser.error("--sim replays bus mode captures only")
+        target_ser = simulated_bus(all_frames)
+    else:
+        if serial is None:
+            parser.error("replaying to a port needs pyserial")
+        target_ser = serial.Serial(port=args.port, baudrate=args.baud)
+
+    out = open(args.out, "wb") if args.out else io.BytesIO()
+    ser = CaptureSerial(target_ser, out, flags)
+    replay(records, ser, args.speed, args.tail)
+
+    if args.out:
+        out.close()
+        _, replayed = read_capture(args.out)
+    else:
+        _, replayed = parse_capture(out.getvalue())
+
+    print("original:")
+    print_stats(all_frames)
+    print("\nreplay:")
+    print_stats(frames(flags, replayed))
+
+
+if __name__ == "__main__":
+    main()
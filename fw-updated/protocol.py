@@ -0,0 +1,309 @@
+"""wire format shared by the updater and its tools, packets, COBS and bus framing, stream
+frames and session captures, no serial port needed
+"""
+import struct
+import time
+from enum import Enum
+
+# comms_packet format
+comms_packet_len = 19
+comms_packet_format = "B B 16s B"
+comms_packet_format_crc = "B B 16s"
+
+PACKET_DATA_LEN_MAX = 16
+DEVICE_ID = 0x69
+SYNC_SEQ = [0x11, 0x22, 0x33, 0x44]
+# same sequence with the last byte replaced selects COBS framing
+SYNC_SEQ_COBS = [0x11, 0x22, 0x33, 0x55]
+# and bus mode, COBS framed and addressed, nodes stay silent until addressed
+SYNC_SEQ_BUS = [0x11, 0x22, 0x33, 0x66]
+COBS_DELIMITER = 0x00
+# set in the length of odd data packets, see PACKET_LEN_ODD
+PACKET_LEN_ODD = 0x80
+
+# stream frames, see shared/inc/core/comms.h
+STREAM_PAYLOAD_LEN = 128
+stream_header_format = "<B B I"
+stream_header_len = struct.calcsize(stream_header_format)
+
+# bus mode, see shared/inc/core/comms.h and bootloader/inc/bl-bus.h
+ADDR_BROADCAST = 0x7F
+ADDR_REPLY = 0x80
+BUS_BLOCK_LEN = STREAM_PAYLOAD_LEN
+BUS_STATUS_BLOCKS = 64
+
+# session captures, see capture.py, {magic, version, flags} then records of
+# {direction, microseconds since the record before, length} and the bytes
+CAPTURE_MAGIC = b"FWCP"
+CAPTURE_VERSION = 1
+capture_header_format = "<4s B B"
+capture_record_format = "<B I H"
+CAPTURE_FLAG_COBS = 0x01
+CAPTURE_FLAG_BUS = 0x02
+CAPTURE_TX = 0
+CAPTURE_RX = 1
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 0x80:
+                crc = (crc << 1) ^ 0x07
+            else:
+                crc <<= 1
+        crc &= 0xFF  # Ensure crc remains a uint8_t
+
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_idx = 0
+    code = 1
+    for byte in data:
+        if byte != 0:
+            out.append(byte)
+            code += 1
+        if byte == 0 or code == 0xFF:
+            out[code_idx] = code
+            code = 1
+            code_idx = len(out)
+            out.append(0)
+    out[code_idx] = code
+
+    return bytes(out)
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    idx = 0
+    while idx < len(frame):
+        code = frame[idx]
+        idx += 1
+        if code == 0 or idx + code - 1 > len(frame):
+            raise ValueError("malformed COBS frame")
+
+        block = frame[idx:idx + code - 1]
+        if COBS_DELIMITER in block:
+            raise ValueError("malformed COBS frame")
+        out += block
+        idx += code - 1
+
+        if code != 0xFF and idx < len(frame):
+            out.append(0)
+
+    return bytes(out)
+
+
+def bus_wrap(address, body):
+    raw = bytes([address]) + body
+    return raw + bytes([crc8(raw)])
+
+
+def stream_frame(seq, payload):
+    raw = struct.pack(stream_header_format, len(payload), PacketType.stream.value, seq) + payload
+    return raw + bytes([crc8(raw)])
+
+
+def parse_stream_frame(frame):
+    """(seq, payload) of a COBS encoded stream frame, ValueError if it is not one"""
+    return parse_stream_body(cobs_decode(frame))
+
+
+def parse_stream_body(raw):
+    if len(raw) < stream_header_len + 1 or crc8(raw[:-1]) != raw[-1]:
+        raise ValueError("bad crc")
+
+    length, packet_type, seq = struct.unpack_from(stream_header_format, raw)
+    if packet_type != PacketType.stream.value or length != len(raw) - stream_header_len - 1:
+        raise ValueError("not a stream frame")
+
+    return seq, raw[stream_header_len:-1]
+
+
+class CaptureSerial:
+    """serial port wrapper recording every write, one frame each, and every read chunk"""
+
+    def __init__(self, ser, out, flags):
+        self.ser = ser
+        self.out = out
+        self.last_ns = time.perf_counter_ns()
+        out.write(struct.pack(capture_header_format, CAPTURE_MAGIC, CAPTURE_VERSION, flags))
+
+    def record(self, direction, data):
+        if not data:
+            return
+        now = time.perf_counter_ns()
+        delta_us = min((now - self.last_ns) // 1000, 0xFFFFFFFF)
+        # advance by what was stored, rounding does not add up over a long session
+        self.last_ns += delta_us * 1000
+        for offset in range(0, len(data), 0xFFFF):
+            chunk = data[offset:offset + 0xFFFF]
+            self.out.write(struct.pack(capture_record_format, direction, delta_us, len(chunk)))
+            self.out.write(chunk)
+            delta_us = 0
+
+    @property
+    def in_waiting(self):
+        return self.ser.in_waiting
+
+    def read(self, size=1):
+        data = self.ser.read(size)
+        self.record(CAPTURE_RX, data)
+        return data
+
+    def write(self, data):
+        self.record(CAPTURE_TX, bytes(data))
+        return self.ser.write(data)
+
+    def __getattr__(self, name):
+        return getattr(self.ser, name)
+
+
+def parse_capture(data):
+    """flags and the records as (microseconds since the start, direction, bytes)"""
+    magic, version, flags = struct.unpack_from(capture_header_format, data)
+    if magic != CAPTURE_MAGIC or version != CAPTURE_VERSION:
+        raise ValueError("not a capture of version {}".format(CAPTURE_VERSION))
+
+    records = []
+    offset = struct.calcsize(capture_header_format)
+    t_us = 0
+    while offset < len(data):
+        direction, delta_us, length = struct.unpack_from(capture_record_format, data, offset)
+        offset += struct.calcsize(capture_record_format)
+        t_us += delta_us
+        records.append((t_us, direction, data[offset:offset + length]))
+        offset += length
+
+    return flags, records
+
+
+def read_capture(path):
+    with open(path, "rb") as f:
+        return parse_capture(f.read())
+
+
+class Direction(Enum):
+    RX = 1
+    TX = 2
+
+
+class PacketType(Enum):
+    data = 0
+    ack = 1
+    retx = 2
+    seq_observed = 3
+    fw_update_req = 4
+    fw_update_res = 5
+    device_id_req = 6
+    device_id_res = 7
+    fw_length_req = 8
+    fw_length_res = 9
+    ready_for_firmware = 10
+    fw_update_successful = 11
+    fw_update_aborted = 12
+    fw_info_req = 13
+    fw_info_res = 14
+    stream = 15
+    read_req = 16
+    read_res = 17
+    crc_req = 18
+    crc_res = 19
+    block_status_req = 20
+    block_status_res = 21
+    unknown = 22
+
+    def __str__(self):
+        return str(self._name_)
+
+
+class Packet:
+    def __init__(self):
+        self.dir = Direction.TX
+        self.length = 0
+        self.type = 0
+        self.data = bytes(0xff for _ in range(PACKET_DATA_LEN_MAX))
+        self.crc = 0
+
+    @staticmethod
+    def create_by_type(type: PacketType):
+        packet = Packet()
+        packet.type = type.value
+        return packet
+
+    def set_data(self, data: bytes):
+        if (len(data) > PACKET_DATA_LEN_MAX):
+            raise Exception("Packet data size exceeded")
+
+        self.length = len(data)
+        self.data = data
+
+        if self.length < PACKET_DATA_LEN_MAX:
+            self.data = self.data + \
+                bytes(0xff for _ in range(PACKET_DATA_LEN_MAX - self.length))
+
+    @staticmethod
+    def create_ctrl_packet(type: PacketType):
+        packet = Packet.create_by_type(type)
+        packet.update_crc()
+
+        return packet
+
+    @staticmethod
+    def deserialize(bytes):
+        packet = Packet()
+        unpacked_data = struct.unpack(comms_packet_format, bytes)
+        packet.dir = Direction.RX
+        packet.length = unpacked_data[0]
+        packet.type = unpacked_data[1]
+        packet.data = unpacked_data[2]
+        packet.crc = unpacked_data[3]
+
+        return packet
+
+    def serialize(self):
+        bytes = struct.pack(
+            comms_packet_format,
+            self.length,
+            self.type,
+            self.data,
+            self.crc,
+        )
+
+        return bytes
+
+    def calculate_crc(self):
+        packed_data = struct.pack(
+            comms_packet_format_crc, self.length, self.type, self.data
+        )
+        return crc8(packed_data)
+
+    def update_crc(self):
+        self.crc = self.calculate_crc()
+
+    def log(self):
+        packet_type_str = str(PacketType(self.type))
+
+        # Convert the data field to a hex string for readability
+        data_hex = " ".join(f"{byte:02X}" for byte in self.data)
+
+        # Log the packet
+
+        crc_status = "valid"
+        if self.calculate_crc() != self.crc:
+            crc_status = f"invalid, expected: 0x{self.calculate_crc():02X}"
+
+        direction_str = ""
+        if (self.dir == Direction.RX):
+            direction_str = "<- (RX)"
+        else:
+            direction_str = "-> (TX)"
+
+        print(f"Packet Log: {direction_str}")
+        print(f"  Length: {self.length}")
+        print(f"  Type: {packet_type_str} ({self.type})")
+        print(f"  Data (hex): {data_hex}")
+        print(f"  CRC: 0x{self.crc:02X} - {crc_status}")
@@ -0,0 +1,118 @@
+import argparse
+import struct
+import time
+import serial
+
+from protocol import COBS_DELIMITER, parse_stream_frame
+
+# struct telemetry_sample, see app/src/telemetry.c
+telemetry_sample_format = "<I I H 27h"
+
+
+class StreamStats:
+    def __init__(self):
+        self.wire_bytes = 0
+        self.frames = 0
+        self.payload_bytes = 0
+        self.bad_frames = 0
+        self.lost_frames = 0
+        self.dropped_samples = 0
+        self.next_seq = None
+        self.next_sample_idx = None
+
+    def on_frame(self, seq, payload):
+        # seq only counts frames that were sent, a gap is a frame lost on the line
+        seq_gap = 0
+        if self.next_seq is not None:
+            seq_gap = (seq - self.next_seq) & 0xFFFFFFFF
+            self.lost_frames += seq_gap
+        self.next_seq = (seq + 1) & 0xFFFFFFFF
+
+        # the device skips a sample without using a seq when its TX buffer is full, only
+        # sample_idx shows those, what it misses beyond the lost frames was never sent
+        if len(payload) == struct.calcsize(telemetry_sample_format):
+            (sample_idx,) = struct.unpack_from("<I", payload)
+            if self.next_sample_idx is not None:
+                sample_gap = (sample_idx - self.next_sample_idx) & 0xFFFFFFFF
+                self.dropped_samples += max(0, sample_gap - seq_gap)
+            self.next_sample_idx = (sample_idx + 1) & 0xFFFFFFFF
+
+        self.frames += 1
+        self.payload_bytes += len(payload)
+
+
+def report(stats, elapsed, baud):
+    # 8N1, 10 bit times per byte
+    line_bytes_per_s = baud / 10
+    line_load = 100.0 * stats.wire_bytes / elapsed / line_bytes_per_s
+    print("{:8.0f} B/s  {:6.0f} frames/s  payload {:8.0f} B/s  line {:5.1f}%  "
+          "lost {}  dropped {}  bad {}".format(stats.wire_bytes / elapsed,
+                                               stats.frames / elapsed,
+                                               stats.payload_bytes / elapsed, line_load,
+                                               stats.lost_frames, stats.dropped_samples,
+                                               stats.bad_frames))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="receive the app telemetry stream")
+    parser.add_argument("--port", default="/dev/ttyUSB0", help="telemetry serial device")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--duration", type=float, default=0, help="seconds, 0 runs forever")
+    parser.add_argument("--samples", action="store_true", help="print decoded samples")
+    args = parser.parse_args()
+
+    ser = serial.Serial(args.port, args.baud, timeout=0.1)
+    ser.reset_input_buffer()
+
+    total = StreamStats()
+    window = StreamStats()
+    pending = bytearray()
+    # the first frame is most likely cut, drop everything up to the first delimiter
+    synced = False
+    start = window_start = time.monotonic()
+
+    while args.duration == 0 or time.monotonic() - start < args.duration:
+        chunk = ser.read(max(1, ser.in_waiting))
+        total.wire_bytes += len(chunk)
+        window.wire_bytes += len(chunk)
+        pending += chunk
+
+        while True:
+            end = pending.find(COBS_DELIMITER)
+            if end < 0:
+                break
+            frame = bytes(pending[:end])
+            del pending[:end + 1]
+            if not synced:
+                synced = True
+                continue
+            if not frame:
+                continue
+
+            try:
+                seq, payload = parse_stream_frame(frame)
+            except ValueError:
+                total.bad_frames += 1
+                window.bad_frames += 1
+                continue
+
+            window.next_seq = total.next_seq
+            window.next_sample_idx = total.next_sample_idx
+            total.on_frame(seq, payload)
+            window.on_frame(seq, payload)
+            if args.samples and len(payload) == struct.calcsize(telemetry_sample_format):
+                sample = struct.unpack(telemetry_sample_format, payload)
+                print("#{} t={}us duty={} ch0={}".format(*sample[:4]))
+
+        now = time.monotonic()
+        if now - window_start >= 1.0:
+            report(window, now - window_start, args.baud)
+            window = StreamStats()
+            window_start = now
+
+    print("total:")
+    report(total, time.monotonic() - start, args.baud)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,124 @@
+#define _DEFAULT_SOURCE
+
+#include "bl-stub.h"
+#include "bl-flash.h"
+#include "core/cache.h"
+#include "core/system.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// what the bootloader engine needs from the target, flash is RAM that programs like flash
+#define STUB_APP_ADDRESS    (0x08000000U + BOOTLOADER_SIZE)
+// dual bank the update goes to the inactive bank, mapped 1 MiB above the active one
+#define STUB_UPDATE_ADDRESS (STUB_APP_ADDRESS + 0x100000U)
+#define STUB_FLASH_SIZE	    (64 * 1024)
+
+static uint8_t *s_app;
+static uint8_t *s_update;
+static bool	s_dual_bank;
+
+static uint8_t *map_flash(uint32_t address)
+{
+	void *p = mmap((void *)(uintptr_t)address, STUB_FLASH_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED || (uintptr_t)p != address) {
+		return NULL;
+	}
+	memset(p, 0xff, STUB_FLASH_SIZE);
+
+	return p;
+}
+
+uint32_t bl_stub_flash_setup(bool dual_bank)
+{
+	if (!s_app && !(s_app = map_flash(STUB_APP_ADDRESS))) {
+		return 0;
+	}
+	if (dual_bank && !s_update && !(s_update = map_flash(STUB_UPDATE_ADDRESS))) {
+		return 0;
+	}
+	s_dual_bank = dual_bank;
+
+	return dual_bank ? STUB_UPDATE_ADDRESS : STUB_APP_ADDRESS;
+}
+
+uint32_t bl_stub_app_address(void)
+{
+	return STUB_APP_ADDRESS;
+}
+
+static uint8_t *flash_at(uint32_t address)
+{
+	if (address >= STUB_UPDATE_ADDRESS) {
+		return &s_update[address - STUB_UPDATE_ADDRESS];
+	}
+
+	return &s_app[address - STUB_APP_ADDRESS];
+}
+
+bool bl_flash_is_dual_bank(void)
+{
+	return s_dual_bank;
+}
+
+void bl_flash_erase_main_app(void)
+{
+	memset(s_dual_bank ? s_update : s_app, 0xff, STUB_FLASH_SIZE);
+}
+
+// the stepped erase is done by the first step
+void bl_flash_erase_start(void)
+{
+}
+
+bool bl_flash_erase_step(void)
+{
+	bl_flash_erase_main_app();
+	return true;
+}
+
+uint32_t bl_flash_get_main_app_available_size(void)
+{
+	return STUB_FLASH_SIZE;
+}
+
+// programming only clears bits
+void bl_flash_write(const uint32_t address, const uint8_t *data, size_t len)
+{
+	uint8_t *dst = flash_at(address);
+
+	for (size_t i = 0; i < len; ++i) {
+		dst[i] &= data[i];
+	}
+}
+
+void bl_flash_program_words(uint32_t address, const uint32_t *words, uint32_t count)
+{
+	bl_flash_write(address, (const uint8_t *)words, count * sizeof(uint32_t));
+}
+
+void cache_invalidate_dcache(void *addr, uint32_t len)
+{
+	(void)addr;
+	(void)len;
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+uint64_t system_get_us(void)
+{
+	return now_us();
+}
+
+uint64_t system_get_ticks(void)
+{
+	return now_us() / 1000;
+}
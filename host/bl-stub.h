@@ -0,0 +1,14 @@
+#ifndef HOST_BL_STUB_H
+#define HOST_BL_STUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// the bootloader engine addresses flash with 32-bit integers, its host stand-in is mapped
+// below 4 GiB at the app start of the target, dual bank also at the same offset of the
+// second bank, returns the address updates are programmed to, 0 if an address is taken
+uint32_t bl_stub_flash_setup(bool dual_bank);
+// where the installed image runs, the load address stamped into headers
+uint32_t bl_stub_app_address(void);
+
+#endif /* HOST_BL_STUB_H */
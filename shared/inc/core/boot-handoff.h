@@ -0,0 +1,42 @@
+#ifndef INC_CORE_BOOT_HANDOFF_H
+#define INC_CORE_BOOT_HANDOFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// state passed from the bootloader to the app in a RAM block both linker scripts
+// reserve at the same address (.boot_handoff), never initialized by the startup code
+#define BOOT_HANDOFF_MAGIC   (0xB007C0DEU)
+#define BOOT_HANDOFF_VERSION (1U)
+
+enum boot_update_result {
+	boot_update_result_none, // no update attempted, sync was not seen
+	boot_update_result_done,
+	boot_update_result_aborted,
+};
+
+struct boot_handoff {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size; // sizeof at the writer, newer fields are appended only
+	uint32_t sysclk_hz;	  // 0 if the clock tree was not set up
+	uint32_t reset_flags;	  // RCC_CSR captured at bootloader entry
+	uint64_t handoff_ticks;	  // system ticks at the jump, ms since reset
+	uint32_t handoff_cycles;  // DWT cycle counter at the jump, keeps running
+	uint32_t update_result;	  // enum boot_update_result
+	uint32_t fw_length;	  // bytes received by the last update
+	uint8_t	 reserved[3];
+	uint8_t	 crc;		  // crc8 of everything above
+};
+
+// bootloader side, reset flags are latched and cleared by boot_handoff_begin
+void boot_handoff_begin(void);
+void boot_handoff_publish(enum boot_update_result result, uint32_t fw_length);
+
+// app side, copies a valid block out and invalidates it so it is consumed once
+bool boot_handoff_take(struct boot_handoff *out);
+
+const char *boot_handoff_reset_reason_str(uint32_t reset_flags);
+const char *boot_update_result_str(enum boot_update_result result);
+
+#endif /* INC_CORE_BOOT_HANDOFF_H */
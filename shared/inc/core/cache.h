@@ -0,0 +1,21 @@
+#ifndef INC_CORE_CACHE_H
+#define INC_CORE_CACHE_H
+
+#include <stdint.h>
+
+// Cortex-M7 L1 cache line size
+#define CACHE_LINE_SIZE 32
+
+// invalidates and enables I/D caches, enables flash ART and prefetch
+void cache_enable(void);
+// cleans D-cache to memory and disables both caches, call before handing over control
+void cache_disable(void);
+
+// DMA helpers, the range is widened to whole cache lines
+// clean: write dirty lines back before a DMA reads the buffer
+// invalidate: drop stale lines after a DMA wrote the buffer
+void cache_clean_dcache(const void *addr, uint32_t len);
+void cache_invalidate_dcache(void *addr, uint32_t len);
+void cache_clean_invalidate_dcache(void *addr, uint32_t len);
+
+#endif /* INC_CORE_CACHE_H */
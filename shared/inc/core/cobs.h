@@ -0,0 +1,21 @@
+#ifndef INC_CORE_COBS_H
+#define INC_CORE_COBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// consistent overhead byte stuffing, the encoded output never contains 0x00,
+// so 0x00 can delimit frames and a receiver resyncs at the next delimiter
+#define COBS_DELIMITER		(0x00)
+#define COBS_MAX_ENCODED_LEN(n) ((n) + ((n) / 254) + 1)
+
+// encodes len bytes into dst, which must hold COBS_MAX_ENCODED_LEN(len) bytes,
+// returns the encoded length, the delimiter is not appended
+uint32_t cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst);
+
+// decodes one frame without its delimiter, dst may alias src,
+// false if the frame is malformed or does not fit dst_size
+bool cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_size,
+		 uint32_t *decoded_len);
+
+#endif /* INC_CORE_COBS_H */
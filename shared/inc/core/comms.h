@@ -0,0 +1,147 @@
+#ifndef INC_CORE_COMMS_H
+#define INC_CORE_COMMS_H
+
+#include "core/cobs.h"
+#include "core/ring_buffer.h"
+#include "core/transport.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PACKET_DATA_LEN	   16
+#define PACKET_RB_LEN	   256
+#define COMMS_RX_CHUNK_LEN 32
+
+// set in the length of data packets of odd index, a retransmitted duplicate has the parity
+// of the packet before the expected one and is dropped
+#define PACKET_LEN_ODD 0x80
+
+enum comms_packet_type {
+	comms_packet_type_data		     = 0,
+	comms_packet_type_ack		     = 1,
+	comms_packet_type_retx		     = 2,
+	comms_packet_type_seq_observed	     = 3,
+	comms_packet_type_fw_update_req	     = 4,
+	comms_packet_type_fw_update_res	     = 5,
+	comms_packet_type_device_id_req	     = 6,
+	comms_packet_type_device_id_res	     = 7,
+	comms_packet_type_fw_length_req	     = 8,
+	comms_packet_type_fw_length_res	     = 9,
+	comms_packet_type_ready_for_firmware = 10,
+	comms_packet_type_update_successful  = 11,
+	comms_packet_type_fw_update_aborted  = 12,
+	comms_packet_type_fw_info_req	     = 13,
+	comms_packet_type_fw_info_res	     = 14,
+	comms_packet_type_stream	     = 15,
+	comms_packet_type_read_req	     = 16,
+	comms_packet_type_read_res	     = 17,
+	comms_packet_type_crc_req	     = 18,
+	comms_packet_type_crc_res	     = 19,
+	comms_packet_type_block_status_req   = 20,
+	comms_packet_type_block_status_res   = 21,
+	comms_packet_type_unknown	     = 22,
+	comms_packet_type_max		     = 23,
+};
+const char *comms_packet_type_str(enum comms_packet_type);
+
+struct comms_packet {
+	uint8_t length;
+	uint8_t type;
+	uint8_t data[PACKET_DATA_LEN];
+	uint8_t crc;
+};
+void log_packet(const struct comms_packet *packet);
+
+#define COMMS_FRAME_LEN COBS_MAX_ENCODED_LEN(sizeof(struct comms_packet))
+
+enum comms_framing {
+	comms_framing_fixed, // packets back to back, a lost byte misaligns every later one
+	comms_framing_cobs,  // COBS encoded packets delimited by 0x00, resyncs per frame
+};
+
+// stream frames, unacknowledged and sequence numbered, COBS framing only
+// {payload length, comms_packet_type_stream, seq (LE32), payload, crc8 of all before}
+#define COMMS_STREAM_PAYLOAD_LEN 128
+#define COMMS_STREAM_HEADER_LEN	 6
+#define COMMS_STREAM_FRAME_LEN	 (COMMS_STREAM_HEADER_LEN + COMMS_STREAM_PAYLOAD_LEN + 1)
+
+// bus mode, COBS framing only, several nodes on one line (RS-485)
+// {address, packet or stream frame, crc8 of all before}, host to node frames carry the
+// destination, node to host frames the source with COMMS_ADDR_REPLY set, so nodes skip them
+#define COMMS_ADDR_NONE	     (0x00) // point to point, no address byte
+#define COMMS_ADDR_BROADCAST (0x7F) // never acked nor retransmitted, nodes only listen
+#define COMMS_ADDR_REPLY     (0x80)
+#define COMMS_BUS_OVERHEAD   2
+#define COMMS_RX_FRAME_LEN   COBS_MAX_ENCODED_LEN(COMMS_STREAM_FRAME_LEN + COMMS_BUS_OVERHEAD)
+
+typedef void (*comms_stream_handler_t)(void *ctx, uint32_t seq, const uint8_t *payload,
+				       uint32_t length);
+
+enum comms_state_t {
+	comms_state_length,
+	comms_state_type,
+	comms_state_data,
+	comms_state_crc,
+};
+
+struct comms_stats {
+	uint64_t buffer_full_cnt;
+	uint64_t crc_bad_cnt;
+	uint64_t frame_bad_cnt; // COBS frames dropped as malformed or of wrong length
+	uint64_t stream_tx_cnt;
+	uint64_t stream_full_cnt; // stream frames refused, transport had no room
+	uint64_t stream_rx_cnt;
+	uint64_t addr_skip_cnt; // bus frames for other nodes
+	uint64_t tx_packets_cnt[comms_packet_type_max];
+	uint64_t rx_packets_cnt[comms_packet_type_max];
+};
+
+struct comms;
+void comms_print_stats(const struct comms *comms);
+
+struct comms {
+	struct transport      *transport;
+	enum comms_framing     framing;
+	enum comms_state_t     state;
+	uint8_t		       data_idx;
+	uint8_t		       frame_buffer[COMMS_RX_FRAME_LEN];
+	uint8_t		       frame_len;
+	bool		       frame_overflow;
+	uint8_t		       address;
+	bool		       rx_broadcast; // the frame being handled
+	struct comms_packet    packet_buffer;
+	struct comms_packet    last_write_packet;
+	uint8_t		       packet_rb_buffer[PACKET_RB_LEN];
+	struct ring_buffer     packet_rb;
+	uint32_t	       stream_seq;
+	comms_stream_handler_t stream_handler;
+	void		      *stream_ctx;
+	bool		       isr_mode;
+	struct comms_stats     stats;
+};
+
+void comms_setup(struct comms *comms, struct transport *transport);
+// drops any partially received packet, fixed framing is the default
+void comms_set_framing(struct comms *comms, enum comms_framing framing);
+// COMMS_ADDR_NONE for point to point, otherwise bus mode with this node address,
+// switches to COBS framing, frames with a bad address or crc are dropped without a retx
+void comms_set_address(struct comms *comms, uint8_t address);
+// received stream frames are handed over here, without a handler they are dropped
+void comms_set_stream_handler(struct comms *comms, comms_stream_handler_t handler, void *ctx);
+// parsing, crc checks and the ack and retx replies move into the transport rx handler,
+// interrupt context on a UART, only complete packets are left for the main loop, the stream
+// handler runs there as well, framing and address must be set before, false if the
+// transport cannot do it, comms_update has nothing left to do then
+bool comms_set_isr_mode(struct comms *comms, bool enable);
+void comms_update(struct comms *comms);
+bool comms_packet_available(struct comms *comms);
+void comms_send(struct comms *comms, struct comms_packet *packet);
+void comms_send_control_packet(struct comms *comms, enum comms_packet_type type);
+void comms_receive(struct comms *comms, struct comms_packet *packet);
+
+// never blocks, false without using up a sequence number if the transport has no room,
+// so gaps seen by the receiver are frames lost on the way
+bool comms_stream_send(struct comms *comms, const uint8_t *payload, uint32_t length);
+
+uint8_t comms_compute_crc(const struct comms_packet *packet);
+
+#endif /* INC_CORE_COMMS_H */
@@ -0,0 +1,14 @@
+#ifndef INC_CORE_CRC32_H
+#define INC_CORE_CRC32_H
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected), same as zlib.crc32 on the host
+// crc32_final(crc32_update(CRC32_INIT, ...)), update can be chained over chunks
+#define CRC32_INIT (0xFFFFFFFFU)
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t length);
+uint32_t crc32_final(uint32_t crc);
+uint32_t crc32(const uint8_t *data, uint32_t length);
+
+#endif /* INC_CORE_CRC32_H */
@@ -0,0 +1,28 @@
+#ifndef INC_CORE_EVENT_LOOP_H
+#define INC_CORE_EVENT_LOOP_H
+
+#include "core/timer-wheel.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EVENT_SYSTICK (1U << 0)
+#define EVENT_UART_RX (1U << 1)
+#define EVENT_USER(n) (1U << (8 + (n)))
+
+#define EVENT_LOOP_MAX_HANDLERS 8
+
+typedef void (*event_handler_t)(uint32_t events, void *ctx);
+
+// the loop drives the given timer wheel, tw may be NULL
+void event_loop_setup(struct timer_wheel *tw);
+bool event_loop_subscribe(uint32_t events, event_handler_t handler, void *ctx);
+
+// safe to call from ISRs, sets the flags and wakes the loop up
+void event_loop_post(uint32_t events);
+
+// dispatches pending events and due timers, then sleeps (WFI) until the next
+// interrupt if nothing is pending, see system_idle, the SysTick only wakes it on
+// a timer deadline or once the longest period it can be stretched to ran out
+void event_loop_run_once(void);
+
+#endif /* INC_CORE_EVENT_LOOP_H */
@@ -0,0 +1,13 @@
+#ifndef INC_CORE_FMT_H
+#define INC_CORE_FMT_H
+
+#include <stdarg.h>
+
+typedef void (*fmt_putc_t)(void *ctx, char c);
+
+// printf subset without newlib stdio:
+// %% %c %s %d %i %u %x %X %p, flags '-' '0', width, length modifiers hh h l ll
+// returns the number of characters emitted
+int fmt_vformat(fmt_putc_t putc, void *ctx, const char *fmt, va_list args);
+
+#endif /* INC_CORE_FMT_H */
@@ -0,0 +1,40 @@
+#ifndef INC_CORE_IMAGE_HEADER_H
+#define INC_CORE_IMAGE_HEADER_H
+
+#include <stdint.h>
+
+// metadata the app carries at a fixed offset from its start, right after the vector table
+// the app build fills fw_version and load_address, app/stamp-image.py patches in the size
+// and digests after linking
+#define IMAGE_HEADER_MAGIC   (0x31474D49U) // "IMG1"
+#define IMAGE_HEADER_VERSION (1U)
+#define IMAGE_HEADER_OFFSET  (0x400U)
+
+#define IMAGE_FW_VERSION(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+
+struct image_header {
+	uint32_t magic;
+	uint16_t header_version;
+	uint16_t header_size;
+	uint32_t fw_version;   // IMAGE_FW_VERSION
+	uint32_t load_address; // where the image (its vector table) starts
+	uint32_t image_size;   // bytes from load_address, header included
+	uint32_t image_crc32;  // crc32 of the image with the header bytes skipped
+	uint32_t header_crc32; // crc32 of the header fields above
+};
+
+enum image_status {
+	image_status_no_header, // erased, interrupted update or a build without header
+	image_status_valid,
+	image_status_corrupt, // header is fine, the image does not match its digest
+};
+
+// checks the header of the image at address and the digest of the whole image, the header
+// must name load_address, which differs from address for an image not yet where it runs,
+// max_size bounds how much flash the header may claim
+enum image_status image_check(uint32_t address, uint32_t load_address, uint32_t max_size,
+			      const struct image_header **header);
+
+const char *image_status_str(enum image_status status);
+
+#endif /* INC_CORE_IMAGE_HEADER_H */
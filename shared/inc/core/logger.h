@@ -3,8 +3,12 @@
 
 #include <stdio.h>
 
-
+// newlib stdio stream, pulls printf and friends into the image
 FILE * create_logger(void);
 void destroy_logger(void);
 
+// printf-free variant backed by core/fmt, see fmt.h for supported conversions
+void logger_setup(void);
+void logger_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
 #endif /* INC_CORE_LOGGER_H */
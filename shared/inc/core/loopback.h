@@ -0,0 +1,30 @@
+#ifndef INC_CORE_LOOPBACK_H
+#define INC_CORE_LOOPBACK_H
+
+#include "core/ring_buffer.h"
+#include "core/transport.h"
+#include <stdint.h>
+
+// in-memory transport, the peer feeds bytes the user reads and drains bytes the user wrote
+// without an out buffer written bytes are only counted
+struct loopback {
+	struct ring_buffer in;
+	struct ring_buffer out;
+	uint32_t	   out_size;
+	uint32_t	   written_cnt;
+	uint32_t	   dropped_cnt;
+	// fed bytes go straight to it, like a UART ISR hands them over
+	transport_rx_handler_t rx_handler;
+	void		      *rx_ctx;
+	struct transport       transport;
+};
+
+void		  loopback_setup(struct loopback *lb, uint8_t *in_buffer, uint32_t in_size,
+				 uint8_t *out_buffer, uint32_t out_size);
+struct transport *loopback_transport(struct loopback *lb);
+
+// peer side
+uint32_t loopback_feed(struct loopback *lb, const uint8_t *data, uint32_t length);
+uint32_t loopback_drain(struct loopback *lb, uint8_t *data, uint32_t length);
+
+#endif /* INC_CORE_LOOPBACK_H */
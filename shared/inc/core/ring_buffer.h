@@ -19,6 +19,7 @@ bool ring_buffer_write(struct ring_buffer * rb, uint8_t byte);
 bool ring_buffer_read(struct ring_buffer * rb, uint8_t * byte);
 bool ring_buffer_write_many(struct ring_buffer * rb, const uint8_t * data, uint32_t data_len);
 bool ring_buffer_read_many(struct ring_buffer * rb, uint8_t * data, uint32_t data_len);
+uint32_t ring_buffer_read_up_to(struct ring_buffer * rb, uint8_t * data, uint32_t max_len);
 
 
 
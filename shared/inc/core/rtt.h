@@ -0,0 +1,25 @@
+#ifndef INC_CORE_RTT_H
+#define INC_CORE_RTT_H
+
+#include <stdint.h>
+
+// round trip time estimator, RFC 6298 smoothing, in ticks of the caller's clock
+// SRTT and RTTVAR are kept scaled by 8 and 4, the 1/8 and 1/4 gains stay exact in integers
+struct rtt_estimator {
+	uint32_t srtt_x8;
+	uint32_t rttvar_x4;
+	uint32_t rto;
+	uint32_t min_rto;
+	uint32_t max_rto;
+	uint32_t sample_cnt;
+};
+
+void rtt_setup(struct rtt_estimator *rtt, uint32_t initial_rto, uint32_t min_rto,
+	       uint32_t max_rto);
+// one measured round trip, never one of a retransmitted exchange (Karn's algorithm)
+void rtt_sample(struct rtt_estimator *rtt, uint32_t rtt_ticks);
+uint32_t rtt_rto(const struct rtt_estimator *rtt);
+uint32_t rtt_srtt(const struct rtt_estimator *rtt);
+uint32_t rtt_rttvar(const struct rtt_estimator *rtt);
+
+#endif /* INC_CORE_RTT_H */
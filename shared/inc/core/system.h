@@ -5,12 +5,32 @@
 
 #include <stdint.h>
 
-#define CPU_FREQ 216000000
-#define SYSTICK_FREQ 1000
-#define BOOTLOADER_SIZE 0x10000U
+#define CPU_FREQ	216000000
+#define SYSTICK_FREQ	1000
+#define CYCLES_PER_US	(CPU_FREQ / 1000000)
+#define BOOTLOADER_SIZE 0x8000U
+
+struct boot_handoff;
 
 void system_setup(void);
+// continues from the clock tree and tick count handed over by the bootloader,
+// falls back to system_setup if the clock does not match
+void system_resume(const struct boot_handoff *handoff);
 void system_terminate(void);
+
+// milliseconds since system_setup, safe to call from thread mode and ISRs
 uint64_t system_get_ticks(void);
+// microseconds since system_setup, combines ticks with the SysTick down-counter,
+// safe to call from ISRs, a wrap whose IRQ is still pending counts as a tick
+uint64_t system_get_us(void);
+// raw DWT cycle counter, wraps every ~19.8s at CPU_FREQ, use for short intervals
+uint32_t system_get_cycles(void);
+
+// SysTick posts EVENT_SYSTICK once this tick is reached, lets the event loop sleep
+void system_set_wakeup_tick(uint64_t tick);
+void system_clear_wakeup_tick(void);
+// call with interrupts masked, sleeps (WFI) until one is pending, the SysTick period is
+// stretched up to the wakeup tick meanwhile and the tick count caught up before return
+void system_idle(void);
 
 #endif /* INC_CORE_SYSTEM_H */
@@ -0,0 +1,40 @@
+#ifndef INC_CORE_TCM_H
+#define INC_CORE_TCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// zero wait state, uncached tightly coupled memories of the F7
+// ITCM (16K) for hot code, DTCM (128K) for hot data, both are filled by tcm.c
+// before main runs, calls between flash and ITCM go through linker veneers
+#define TCM_TEXT __attribute__((section(".itcm_text"), noinline))
+#define TCM_DATA __attribute__((section(".dtcm_data")))
+#define TCM_BSS	 __attribute__((section(".dtcm_bss")))
+
+// newlib's memcpy and memchr run from flash, TCM_TEXT code copies and searches with these,
+// inlined into the caller, the firmware builds with -fno-tree-loop-distribute-patterns so
+// the loops are not turned back into library calls
+__attribute__((always_inline)) static inline void
+tcm_memcpy(void *restrict dst, const void *restrict src, uint32_t len)
+{
+	uint8_t	      *d = dst;
+	const uint8_t *s = src;
+
+	while (len-- > 0) {
+		*d++ = *s++;
+	}
+}
+
+__attribute__((always_inline)) static inline const uint8_t *
+tcm_memchr(const uint8_t *data, uint8_t byte, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; ++i) {
+		if (data[i] == byte) {
+			return &data[i];
+		}
+	}
+
+	return NULL;
+}
+
+#endif /* INC_CORE_TCM_H */
@@ -0,0 +1,57 @@
+#ifndef INC_CORE_TIMER_WHEEL_H
+#define INC_CORE_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// hierarchical timing wheel, 4 levels x 64 slots of 1 tick granularity
+// level 0 covers the next 64 ticks, each next level is 64x coarser,
+// timers further than 64^4 ticks away are parked in the last level and re-cascaded
+#define TIMER_WHEEL_LEVELS     4
+#define TIMER_WHEEL_SLOT_BITS  6
+#define TIMER_WHEEL_SLOTS      (1U << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOTS_MASK (TIMER_WHEEL_SLOTS - 1)
+
+struct timer_wheel_timer;
+typedef void (*timer_wheel_callback_t)(struct timer_wheel_timer *timer, void *ctx);
+
+struct timer_wheel_timer {
+	struct timer_wheel_timer *next;
+	struct timer_wheel_timer *prev;
+	uint64_t		  expires;
+	uint64_t		  period; // 0 for one-shot timers
+	timer_wheel_callback_t	  callback;
+	void			 *ctx;
+	bool			  armed;
+	uint8_t			  level;
+	uint8_t			  slot;
+};
+
+struct timer_wheel {
+	uint64_t		  next_tick; // ticks before this one are processed
+	uint32_t		  armed_cnt;
+	uint64_t		  occupied[TIMER_WHEEL_LEVELS];
+	struct timer_wheel_timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	struct timer_wheel_timer *expired; // due timers of the tick being dispatched
+};
+
+void timer_wheel_setup(struct timer_wheel *tw, uint64_t now);
+void timer_wheel_timer_setup(struct timer_wheel_timer *t, timer_wheel_callback_t callback,
+			     void *ctx);
+
+// O(1), (re)arms the timer to fire delay ticks after the last processed tick,
+// period 0 makes it one-shot
+void timer_wheel_arm(struct timer_wheel *tw, struct timer_wheel_timer *t, uint64_t delay,
+		     uint64_t period);
+// O(1), safe to call on a timer that is not armed
+void timer_wheel_cancel(struct timer_wheel *tw, struct timer_wheel_timer *t);
+bool timer_wheel_is_armed(const struct timer_wheel_timer *t);
+
+// processes all ticks up to and including now, dispatching expired callbacks
+void timer_wheel_update(struct timer_wheel *tw, uint64_t now);
+
+// earliest tick at which update has work to do, false if nothing is armed
+// exact for timers within level 0, a lower bound (cascade time) otherwise
+bool timer_wheel_next_deadline(const struct timer_wheel *tw, uint64_t *deadline);
+
+#endif /* INC_CORE_TIMER_WHEEL_H */
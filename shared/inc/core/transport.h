@@ -0,0 +1,40 @@
+#ifndef INC_CORE_TRANSPORT_H
+#define INC_CORE_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// gets bytes right where they arrive, interrupt context on hardware backends,
+// returns true if the main loop has something to pick up
+typedef bool (*transport_rx_handler_t)(void *ctx, const uint8_t *data, uint32_t length);
+
+// byte stream backend used by comms, implemented by uart, loopback, (usb cdc)
+struct transport_ops {
+	// copies up to length already received bytes, returns how many were copied
+	uint32_t (*read)(void *ctx, uint8_t *data, uint32_t length);
+	void (*write)(void *ctx, const uint8_t *data, uint32_t length);
+	uint32_t (*available)(void *ctx);
+	// optional, bytes write can take without blocking or dropping, NULL for blocking backends
+	uint32_t (*writable)(void *ctx);
+	// optional, receive handler instead of read, bytes already received are handed over
+	// first, NULL uninstalls it, backends without it return false
+	bool (*set_rx_handler)(void *ctx, transport_rx_handler_t handler, void *handler_ctx);
+	// optional, holds the rx handler off, nests, for state it shares with the caller
+	void (*lock)(void *ctx);
+	void (*unlock)(void *ctx);
+};
+
+struct transport {
+	const struct transport_ops *ops;
+	void			   *ctx;
+};
+
+uint32_t transport_read(struct transport *t, uint8_t *data, uint32_t length);
+void	 transport_write(struct transport *t, const uint8_t *data, uint32_t length);
+uint32_t transport_available(struct transport *t);
+uint32_t transport_writable(struct transport *t);
+bool	 transport_set_rx_handler(struct transport *t, transport_rx_handler_t handler, void *ctx);
+void	 transport_lock(struct transport *t);
+void	 transport_unlock(struct transport *t);
+
+#endif /* INC_CORE_TRANSPORT_H */
@@ -0,0 +1,41 @@
+#ifndef INC_CORE_UART_DMA_TX_H
+#define INC_CORE_UART_DMA_TX_H
+
+#include "core/cache.h"
+#include "core/transport.h"
+#include "core/uart.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// multiple of the cache line, each buffer is cleaned as a whole before its transfer
+#define UART_DMA_TX_BUFFER_LEN 512
+
+// non-blocking TX for a uart_driver, writes fill one buffer while DMA drains the other,
+// a write that does not fit is dropped whole instead of waiting for the line
+struct uart_dma_tx {
+	struct uart_driver *uart;
+	uint32_t	    dma;
+	uint8_t		    stream;
+	uint32_t	    channel;
+	uint8_t		    nvic_irq;
+
+	uint8_t buffer[2][UART_DMA_TX_BUFFER_LEN] __attribute__((aligned(CACHE_LINE_SIZE)));
+	uint32_t	  fill_len; // bytes waiting in buffer[fill]
+	uint8_t		  fill;
+	volatile bool	  busy; // the other buffer is being sent
+	uint32_t	  sent_cnt;
+	uint32_t	  dropped_cnt;
+	struct transport  transport;
+};
+
+// uart must already be set up, dma, stream, channel and nvic_irq filled in by the caller
+void uart_dma_tx_setup(struct uart_dma_tx *tx);
+// all or nothing, false if the data did not fit next to what is queued
+bool	 uart_dma_tx_write(struct uart_dma_tx *tx, const uint8_t *data, uint32_t length);
+uint32_t uart_dma_tx_writable(struct uart_dma_tx *tx);
+void	 uart_dma_tx_handle_irq(struct uart_dma_tx *tx);
+
+// reads come from the uart RX ring buffer, writes go through DMA
+struct transport *uart_dma_tx_transport(struct uart_dma_tx *tx);
+
+#endif /* INC_CORE_UART_DMA_TX_H */
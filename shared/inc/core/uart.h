@@ -4,9 +4,20 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include "ring_buffer.h"
+#include "transport.h"
 #include <stdbool.h>
 #include <stdint.h>
 
+// RX error counters, only the ISR writes them
+struct uart_stats {
+	uint32_t overrun_cnt;	   // byte lost in the peripheral, the ISR was late
+	uint32_t framing_err_cnt;
+	uint32_t noise_cnt;
+	uint32_t parity_err_cnt;
+	uint32_t rb_overflow_cnt;  // byte lost because nobody drained the ring buffer
+	uint32_t rts_throttle_cnt; // times the peer was told to stop
+};
+
 struct uart_driver {
 	uint32_t	      usart_dev;
 	enum rcc_periph_clken usart_clock_dev;
@@ -18,6 +29,23 @@ struct uart_driver {
 	uint32_t	      baud_rate;
     uint32_t mode;
 
+	// optional flow control, pins on gpio_port, 0 leaves the line unused
+	// CTS is handled by the peripheral (AF gpio_af), TX pauses while the peer holds it high
+	// RTS is a plain output driven from the ring buffer fill, so the peer is stopped
+	// while there is still room for the bytes it has in flight
+	uint32_t cts_pin;
+	uint32_t rts_pin;
+	uint32_t rts_high_watermark; // stop the peer at this fill, 0 for 3/4 of rb_buffer
+	uint32_t rts_low_watermark;  // let it resume at this fill, 0 for 1/4 of rb_buffer
+	volatile bool rts_throttled;
+
+	// optional interrupt driven TX, writes queue up and return while the line is busy,
+	// writes into a full queue wait for the ISR to drain it, or poll where it cannot
+	// run, false keeps every write blocking
+	bool tx_irq;
+
+	struct uart_stats stats;
+
 	// for 115200 Bd/s, (we have 1 symbol per 1 bod, that is 0 or 1)
 	// each 10 symbols represent single byte
 	// so it's actually 11520 bytes/s
@@ -26,16 +54,31 @@ struct uart_driver {
 	// 128B / 11.5(B/ms)  = 11ms
 	uint8_t		   rb_buffer[128];
 	struct ring_buffer rb;
+
+	// installed through the transport, gets every received byte in the ISR instead of rb,
+	// needs tx_irq
+	transport_rx_handler_t rx_handler;
+	void		      *rx_ctx;
+	uint32_t	       lock_depth;
+	volatile bool	       tx_active; // TXE interrupt on, the ISR feeds the line
+	uint8_t		       tx_rb_buffer[256];
+	struct ring_buffer     tx_rb;
 };
 
 void uart_setup(struct uart_driver *drv);
+// waits for queued TX bytes to leave the line first
 void uart_terminate(struct uart_driver *drv);
 void uart_handle_irq(struct uart_driver *drv);
 
-void	 uart_write(struct uart_driver *drv, uint8_t *data, const uint32_t length);
+void	 uart_write(struct uart_driver *drv, const uint8_t *data, const uint32_t length);
 void	 uart_write_byte(struct uart_driver *drv, uint8_t data);
 uint32_t uart_read(struct uart_driver *drv, uint8_t *data, const uint32_t length);
 uint8_t	 uart_read_byte(struct uart_driver *drv);
 bool	 uart_data_available(struct uart_driver *drv);
+// returns once every written byte is out on the line
+void uart_flush(struct uart_driver *drv);
+
+// exposes the driver as a comms transport
+void uart_transport_setup(struct transport *t, struct uart_driver *drv);
 
 #endif /* INC_CORE_UART_H */
@@ -0,0 +1,94 @@
+#include "core/boot-handoff.h"
+#include "core/crc8.h"
+#include "core/str.h"
+#include "core/system.h"
+#include <libopencm3/stm32/rcc.h>
+#include <stddef.h>
+
+__attribute__((section(".boot_handoff"))) static struct boot_handoff s_handoff;
+
+static uint32_t s_reset_flags;
+
+static uint8_t handoff_crc(const struct boot_handoff *handoff)
+{
+	return crc8((uint8_t *)handoff, offsetof(struct boot_handoff, crc));
+}
+
+void boot_handoff_begin(void)
+{
+	s_reset_flags = RCC_CSR;
+	RCC_CSR |= RCC_CSR_RMVF;
+
+	// a stale block must not outlive a reset that skips the publish
+	s_handoff.magic = 0;
+}
+
+void boot_handoff_publish(enum boot_update_result result, uint32_t fw_length)
+{
+	s_handoff = (struct boot_handoff){
+	    .magic	    = BOOT_HANDOFF_MAGIC,
+	    .version	    = BOOT_HANDOFF_VERSION,
+	    .size	    = sizeof(struct boot_handoff),
+	    .sysclk_hz	    = rcc_ahb_frequency,
+	    .reset_flags    = s_reset_flags,
+	    .handoff_ticks  = system_get_ticks(),
+	    .handoff_cycles = system_get_cycles(),
+	    .update_result  = result,
+	    .fw_length	    = fw_length,
+	};
+	s_handoff.crc = handoff_crc(&s_handoff);
+}
+
+bool boot_handoff_take(struct boot_handoff *out)
+{
+	const bool valid = s_handoff.magic == BOOT_HANDOFF_MAGIC &&
+			   s_handoff.version == BOOT_HANDOFF_VERSION &&
+			   s_handoff.size == sizeof(struct boot_handoff) &&
+			   s_handoff.crc == handoff_crc(&s_handoff);
+
+	if (valid) {
+		*out = s_handoff;
+	}
+	s_handoff.magic = 0;
+
+	return valid;
+}
+
+const char *boot_handoff_reset_reason_str(uint32_t reset_flags)
+{
+	// power-on also sets the pin and brown-out flags, check the most specific first
+	if (reset_flags & RCC_CSR_LPWRRSTF) {
+		return "low-power";
+	}
+	if (reset_flags & RCC_CSR_WWDGRSTF) {
+		return "window watchdog";
+	}
+	if (reset_flags & RCC_CSR_IWDGRSTF) {
+		return "independent watchdog";
+	}
+	if (reset_flags & RCC_CSR_SFTRSTF) {
+		return "software";
+	}
+	if (reset_flags & RCC_CSR_PORRSTF) {
+		return "power-on";
+	}
+	if (reset_flags & RCC_CSR_BORRSTF) {
+		return "brown-out";
+	}
+	if (reset_flags & RCC_CSR_PINRSTF) {
+		return "pin";
+	}
+
+	return "unknown";
+}
+
+const char *boot_update_result_str(enum boot_update_result result)
+{
+	switch (result) {
+		ENUM_CASE(boot_update_result_none)
+		ENUM_CASE(boot_update_result_done)
+		ENUM_CASE(boot_update_result_aborted)
+	default:
+		return "boot_update_result unknown";
+	}
+}
@@ -0,0 +1,128 @@
+#include "core/cache.h"
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/stm32/flash.h>
+
+// cache maintenance registers (ARMv7-M ARM, B3.2.2)
+#define CACHE_CCSIDR   MMIO32(0xE000ED80)
+#define CACHE_CSSELR   MMIO32(0xE000ED84)
+#define CACHE_ICIALLU  MMIO32(0xE000EF50)
+#define CACHE_DCIMVAC  MMIO32(0xE000EF5C)
+#define CACHE_DCISW    MMIO32(0xE000EF60)
+#define CACHE_DCCMVAC  MMIO32(0xE000EF68)
+#define CACHE_DCCIMVAC MMIO32(0xE000EF70)
+#define CACHE_DCCISW   MMIO32(0xE000EF74)
+
+#define CCR_DC (1 << 16)
+#define CCR_IC (1 << 17)
+
+static inline void dsb(void)
+{
+	__asm__ volatile("dsb" ::: "memory");
+}
+
+static inline void isb(void)
+{
+	__asm__ volatile("isb" ::: "memory");
+}
+
+// runs op on every line of the L1 data cache by set/way
+static void dcache_for_each_set_way(volatile uint32_t *op)
+{
+	CACHE_CSSELR = 0; // level 1 data cache
+	dsb();
+
+	const uint32_t ccsidr = CACHE_CCSIDR;
+	const uint32_t sets   = (ccsidr >> 13) & 0x7FFF;
+	const uint32_t ways   = (ccsidr >> 3) & 0x3FF;
+
+	for (uint32_t set = 0; set <= sets; ++set) {
+		for (uint32_t way = 0; way <= ways; ++way) {
+			*op = ((set << 5) & 0x3FE0) | ((way << 30) & 0xC0000000);
+		}
+	}
+	dsb();
+}
+
+static void dcache_by_addr(volatile uint32_t *op, uintptr_t addr, uint32_t len)
+{
+	if (len == 0) {
+		return;
+	}
+
+	uintptr_t	line = addr & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+	const uintptr_t end  = addr + len;
+
+	dsb();
+	for (; line < end; line += CACHE_LINE_SIZE) {
+		*op = line;
+	}
+	dsb();
+	isb();
+}
+
+static void flash_accelerator_enable(void)
+{
+	// ART and prefetch serve the ITCM flash interface (0x00200000), our images run
+	// from the AXIM alias (0x08000000) so the L1 I-cache is what removes the wait states
+	FLASH_ACR &= ~FLASH_ACR_ARTEN;
+	FLASH_ACR |= FLASH_ACR_ARTRST;
+	FLASH_ACR &= ~FLASH_ACR_ARTRST;
+	FLASH_ACR |= FLASH_ACR_ARTEN | FLASH_ACR_PRFTEN;
+}
+
+void cache_enable(void)
+{
+	flash_accelerator_enable();
+
+	if (!(SCB_CCR & CCR_IC)) {
+		dsb();
+		isb();
+		CACHE_ICIALLU = 0;
+		dsb();
+		isb();
+		SCB_CCR |= CCR_IC;
+		dsb();
+		isb();
+	}
+
+	if (!(SCB_CCR & CCR_DC)) {
+		dcache_for_each_set_way(&CACHE_DCISW);
+		SCB_CCR |= CCR_DC;
+		dsb();
+		isb();
+	}
+}
+
+void cache_disable(void)
+{
+	if (SCB_CCR & CCR_DC) {
+		SCB_CCR &= ~CCR_DC;
+		dsb();
+		dcache_for_each_set_way(&CACHE_DCCISW);
+		isb();
+	}
+
+	if (SCB_CCR & CCR_IC) {
+		dsb();
+		isb();
+		SCB_CCR &= ~CCR_IC;
+		CACHE_ICIALLU = 0;
+		dsb();
+		isb();
+	}
+}
+
+void cache_clean_dcache(const void *addr, uint32_t len)
+{
+	dcache_by_addr(&CACHE_DCCMVAC, (uintptr_t)addr, len);
+}
+
+void cache_invalidate_dcache(void *addr, uint32_t len)
+{
+	dcache_by_addr(&CACHE_DCIMVAC, (uintptr_t)addr, len);
+}
+
+void cache_clean_invalidate_dcache(void *addr, uint32_t len)
+{
+	dcache_by_addr(&CACHE_DCCIMVAC, (uintptr_t)addr, len);
+}
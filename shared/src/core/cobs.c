@@ -0,0 +1,59 @@
+#include "core/cobs.h"
+#include "core/tcm.h"
+
+TCM_TEXT uint32_t cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+	uint32_t code_idx = 0;
+	uint32_t out	  = 1;
+	uint8_t	 code	  = 1;
+
+	for (uint32_t i = 0; i < len; ++i) {
+		if (src[i] != 0) {
+			dst[out++] = src[i];
+			code++;
+		}
+
+		// a zero or a full block closes the current block
+		if (src[i] == 0 || code == 0xFF) {
+			dst[code_idx] = code;
+			code	      = 1;
+			code_idx      = out++;
+		}
+	}
+	dst[code_idx] = code;
+
+	return out;
+}
+
+TCM_TEXT bool cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_size,
+			  uint32_t *decoded_len)
+{
+	uint32_t in  = 0;
+	uint32_t out = 0;
+
+	while (in < len) {
+		const uint8_t code = src[in++];
+
+		if (code == 0 || in + code - 1 > len) {
+			return false;
+		}
+
+		for (uint8_t i = 1; i < code; ++i) {
+			if (src[in] == 0 || out >= dst_size) {
+				return false;
+			}
+			dst[out++] = src[in++];
+		}
+
+		// every block but a full one or the last stands for a zero
+		if (code != 0xFF && in < len) {
+			if (out >= dst_size) {
+				return false;
+			}
+			dst[out++] = 0;
+		}
+	}
+
+	*decoded_len = out;
+	return true;
+}
@@ -0,0 +1,498 @@
+#include "core/comms.h"
+#include "core/crc8.h"
+#include "core/logger.h"
+#include "core/str.h"
+#include "core/tcm.h"
+#include <inttypes.h>
+#include <string.h>
+
+// delimiter included, big enough for an addressed stream frame
+#define TX_FRAME_LEN (COMMS_RX_FRAME_LEN + 1)
+
+static struct comms_packet retx_packet = {0};
+static struct comms_packet ack_packet  = {0};
+
+TCM_TEXT uint8_t comms_compute_crc(const struct comms_packet *packet)
+{
+	return crc8((uint8_t *)packet, sizeof(struct comms_packet) - 1); // exclude CRC
+}
+
+void comms_print_stats(const struct comms *comms)
+{
+	logger_printf("Comms Stats:\n");
+	logger_printf("Buffer Full Count: %" PRIu64 "\n", comms->stats.buffer_full_cnt);
+	logger_printf("RX CRC bad count: %" PRIu64 "\n", comms->stats.crc_bad_cnt);
+	logger_printf("RX bad frame count: %" PRIu64 "\n", comms->stats.frame_bad_cnt);
+	logger_printf("Stream TX count: %" PRIu64 "\n", comms->stats.stream_tx_cnt);
+	logger_printf("Stream full count: %" PRIu64 "\n", comms->stats.stream_full_cnt);
+	logger_printf("Stream RX count: %" PRIu64 "\n", comms->stats.stream_rx_cnt);
+	logger_printf("Bus frames for other nodes: %" PRIu64 "\n", comms->stats.addr_skip_cnt);
+	for (int i = 0; i < comms_packet_type_max; ++i) {
+		logger_printf("RX Packets %s Count: %" PRIu64 "\n",
+			      comms_packet_type_str((enum comms_packet_type)i),
+			      comms->stats.rx_packets_cnt[i]);
+	}
+	for (int i = 0; i < comms_packet_type_max; ++i) {
+		logger_printf("TX Packets %s Count: %" PRIu64 "\n",
+			      comms_packet_type_str((enum comms_packet_type)i),
+			      comms->stats.tx_packets_cnt[i]);
+	}
+
+	logger_printf("Buffer space left: %" PRIu32 "\n",
+		      ring_buffer_get_left_space_len(&comms->packet_rb));
+	logger_printf("Buffer space taken: %" PRIu32 "\n",
+		      ring_buffer_get_data_len(&comms->packet_rb));
+}
+
+const char *comms_packet_type_str(enum comms_packet_type type)
+{
+	switch (type) {
+		ENUM_CASE(comms_packet_type_data)
+		ENUM_CASE(comms_packet_type_ack)
+		ENUM_CASE(comms_packet_type_retx)
+		ENUM_CASE(comms_packet_type_seq_observed)
+		ENUM_CASE(comms_packet_type_fw_update_req)
+		ENUM_CASE(comms_packet_type_fw_update_res)
+		ENUM_CASE(comms_packet_type_device_id_req)
+		ENUM_CASE(comms_packet_type_device_id_res)
+		ENUM_CASE(comms_packet_type_fw_length_req)
+		ENUM_CASE(comms_packet_type_fw_length_res)
+		ENUM_CASE(comms_packet_type_ready_for_firmware)
+		ENUM_CASE(comms_packet_type_update_successful)
+		ENUM_CASE(comms_packet_type_fw_update_aborted)
+		ENUM_CASE(comms_packet_type_fw_info_req)
+		ENUM_CASE(comms_packet_type_fw_info_res)
+		ENUM_CASE(comms_packet_type_stream)
+		ENUM_CASE(comms_packet_type_read_req)
+		ENUM_CASE(comms_packet_type_read_res)
+		ENUM_CASE(comms_packet_type_crc_req)
+		ENUM_CASE(comms_packet_type_crc_res)
+		ENUM_CASE(comms_packet_type_block_status_req)
+		ENUM_CASE(comms_packet_type_block_status_res)
+		ENUM_CASE(comms_packet_type_unknown)
+		ENUM_CASE(comms_packet_type_max)
+	default:
+		return "comms_packet_type_invalid";
+	}
+}
+
+void log_packet(const struct comms_packet *packet)
+{
+	const char *type_str = comms_packet_type_str(packet->type);
+
+	logger_printf("Packet:\n");
+	logger_printf(" Length: %d\n", packet->length);
+	logger_printf(" Type %s: (%d)\n", type_str, packet->type);
+	logger_printf(" Data: ");
+	for (int i = 0; i < PACKET_DATA_LEN; ++i) {
+		logger_printf("%02hhX ", packet->data[i]);
+	}
+	logger_printf("\n");
+	const bool crc_valid = comms_compute_crc(packet) == packet->crc;
+	logger_printf(" CRC: %02hhX - %s\n", packet->crc, crc_valid ? "valid" : "invalid");
+}
+
+static void comms_create_control_packet(struct comms_packet *packet, enum comms_packet_type type)
+{
+	packet->length = PACKET_DATA_LEN;
+	packet->type   = type;
+	for (int i = 0; i < PACKET_DATA_LEN; ++i) {
+		packet->data[i] = 0xff;
+	}
+	packet->crc = comms_compute_crc(packet);
+}
+
+void comms_setup(struct comms *comms, struct transport *transport)
+{
+	comms->transport      = transport;
+	comms->stream_seq     = 0;
+	comms->address	      = COMMS_ADDR_NONE;
+	comms->stream_handler = NULL;
+	comms->stream_ctx     = NULL;
+	comms->isr_mode	      = false;
+	comms_create_control_packet(&retx_packet, comms_packet_type_retx);
+	comms_create_control_packet(&ack_packet, comms_packet_type_ack);
+	// a retx before anything was sent gets an ack of nothing
+	comms_create_control_packet(&comms->last_write_packet, comms_packet_type_ack);
+	ring_buffer_setup(&comms->packet_rb, comms->packet_rb_buffer, PACKET_RB_LEN);
+}
+
+void comms_set_framing(struct comms *comms, enum comms_framing framing)
+{
+	comms->framing	      = framing;
+	comms->state	      = comms_state_length;
+	comms->data_idx	      = 0;
+	comms->frame_len      = 0;
+	comms->frame_overflow = false;
+}
+
+void comms_set_address(struct comms *comms, uint8_t address)
+{
+	if (address != COMMS_ADDR_NONE) {
+		comms_set_framing(comms, comms_framing_cobs);
+	}
+	comms->address = address;
+}
+
+void comms_set_stream_handler(struct comms *comms, comms_stream_handler_t handler, void *ctx)
+{
+	comms->stream_handler = handler;
+	comms->stream_ctx     = ctx;
+}
+
+// acks and retx requests, nobody answers a broadcast
+TCM_TEXT static void comms_reply(struct comms *comms, struct comms_packet *packet)
+{
+	if (!comms->rx_broadcast) {
+		comms_send(comms, packet);
+	}
+}
+
+// acks carry {crc, type} of the packet they acknowledge, a peer that asked for the last
+// packet again tells from it whether its own got through
+TCM_TEXT static void comms_send_ack(struct comms *comms, const struct comms_packet *pkt)
+{
+	struct comms_packet ack = ack_packet;
+
+	ack.data[0] = pkt->crc;
+	ack.data[1] = pkt->type;
+	ack.crc	    = comms_compute_crc(&ack);
+	comms_reply(comms, &ack);
+}
+
+#define TRACE_LOG() logger_printf("%s:%d", __func__, __LINE__)
+
+TCM_TEXT static void comms_handle_packet(struct comms *comms, struct comms_packet *pkt)
+{
+	uint8_t actual_crc = comms_compute_crc(pkt);
+
+	if (pkt->crc != actual_crc) {
+		comms->stats.crc_bad_cnt++;
+		comms_reply(comms, &retx_packet);
+		return;
+	}
+
+	switch (pkt->type) {
+	case comms_packet_type_retx: {
+		comms->stats.rx_packets_cnt[(int)comms_packet_type_retx]++;
+		comms_reply(comms, &comms->last_write_packet);
+	} break;
+	case comms_packet_type_ack: {
+		comms->stats.rx_packets_cnt[(int)comms_packet_type_ack]++;
+	} break;
+	default: {
+		const enum comms_packet_type stat_type = (int)pkt->type < (int)comms_packet_type_max
+							     ? pkt->type
+							     : comms_packet_type_unknown;
+
+		comms->stats.rx_packets_cnt[(int)stat_type]++;
+		bool can_be_stored = ring_buffer_get_left_space_len(&comms->packet_rb) >=
+				     sizeof(struct comms_packet);
+
+		if (!can_be_stored) {
+			comms->stats.buffer_full_cnt++;
+			comms_reply(comms,
+				    &retx_packet); // not sure if this is a good
+						   // idea, could make an interrupt "loop"
+		} else {
+			ring_buffer_write_many(&comms->packet_rb, (uint8_t *)pkt,
+					       sizeof(struct comms_packet));
+
+			comms_send_ack(comms, pkt);
+		}
+	}
+	}
+}
+
+// consumes a whole chunk, the data field is copied in bulk
+TCM_TEXT static void comms_consume_fixed(struct comms *comms, const uint8_t *data,
+					 uint32_t len)
+{
+	struct comms_packet *pkt = &comms->packet_buffer;
+	uint32_t	     i	 = 0;
+
+	while (i < len) {
+		switch (comms->state) {
+		case comms_state_length: {
+			pkt->length  = data[i++];
+			comms->state = comms_state_type;
+		} break;
+		case comms_state_type: {
+			pkt->type    = data[i++];
+			comms->state = comms_state_data;
+		} break;
+		case comms_state_data: {
+			const uint32_t missing = PACKET_DATA_LEN - comms->data_idx;
+			const uint32_t n       = (len - i) < missing ? (len - i) : missing;
+
+			tcm_memcpy(&pkt->data[comms->data_idx], &data[i], n);
+			comms->data_idx += n;
+			i += n;
+
+			if (comms->data_idx >= PACKET_DATA_LEN) {
+				comms->data_idx = 0;
+				comms->state	= comms_state_crc;
+			}
+		} break;
+		case comms_state_crc: {
+			pkt->crc     = data[i++];
+			comms->state = comms_state_length;
+			comms_handle_packet(comms, pkt);
+		} break;
+		default:
+			comms->state = comms_state_length;
+		}
+	}
+}
+
+// {length, comms_packet_type_stream, seq, payload, crc8}
+TCM_TEXT static void comms_handle_stream(struct comms *comms, const uint8_t *raw, uint32_t len)
+{
+	if (len < COMMS_STREAM_HEADER_LEN + 1 || raw[0] != len - COMMS_STREAM_HEADER_LEN - 1 ||
+	    crc8((uint8_t *)raw, len - 1) != raw[len - 1]) {
+		// unacknowledged, the receiver finds the gap by the sequence number
+		comms->stats.frame_bad_cnt++;
+		return;
+	}
+
+	comms->stats.stream_rx_cnt++;
+	if (comms->stream_handler) {
+		const uint32_t seq =
+		    raw[2] << 0 | raw[3] << 8 | raw[4] << 16 | (uint32_t)raw[5] << 24;
+
+		comms->stream_handler(comms->stream_ctx, seq, &raw[COMMS_STREAM_HEADER_LEN],
+				      raw[0]);
+	}
+}
+
+TCM_TEXT static void comms_finish_frame(struct comms *comms)
+{
+	uint8_t	 raw[COMMS_STREAM_FRAME_LEN + COMMS_BUS_OVERHEAD];
+	uint32_t len = 0;
+
+	const bool decoded =
+	    !comms->frame_overflow &&
+	    cobs_decode(comms->frame_buffer, comms->frame_len, raw, sizeof(raw), &len);
+
+	comms->frame_len      = 0;
+	comms->frame_overflow = false;
+	comms->rx_broadcast   = false;
+
+	if (!decoded) {
+		// only this frame is lost, the next one starts after the delimiter just seen,
+		// on a bus it may not even have been ours, so nobody asks for it again
+		comms->stats.frame_bad_cnt++;
+		if (comms->address == COMMS_ADDR_NONE) {
+			comms_send(comms, &retx_packet);
+		}
+		return;
+	}
+
+	const uint8_t *body = raw;
+	if (comms->address != COMMS_ADDR_NONE) {
+		if (len < COMMS_BUS_OVERHEAD || crc8(raw, len - 1) != raw[len - 1]) {
+			comms->stats.frame_bad_cnt++;
+			return;
+		}
+		// replies of other nodes carry COMMS_ADDR_REPLY and never match
+		if (raw[0] != comms->address && raw[0] != COMMS_ADDR_BROADCAST) {
+			comms->stats.addr_skip_cnt++;
+			return;
+		}
+		comms->rx_broadcast = raw[0] == COMMS_ADDR_BROADCAST;
+		body		    = &raw[1];
+		len -= COMMS_BUS_OVERHEAD;
+	}
+
+	// a stream frame may be packet sized, the type tells them apart
+	if (len > 1 && body[1] == comms_packet_type_stream) {
+		comms_handle_stream(comms, body, len);
+	} else if (len == sizeof(struct comms_packet)) {
+		tcm_memcpy(&comms->packet_buffer, body, len);
+		comms_handle_packet(comms, &comms->packet_buffer);
+	} else {
+		comms->stats.frame_bad_cnt++;
+		comms_reply(comms, &retx_packet);
+	}
+}
+
+// runs between delimiters are copied in bulk, oversized frames are dropped at their end
+TCM_TEXT static void comms_consume_cobs(struct comms *comms, const uint8_t *data,
+					uint32_t len)
+{
+	uint32_t i = 0;
+
+	while (i < len) {
+		const uint8_t *delim = tcm_memchr(&data[i], COBS_DELIMITER, len - i);
+		const uint32_t run   = delim ? (uint32_t)(delim - &data[i]) : len - i;
+		const uint32_t room  = sizeof(comms->frame_buffer) - comms->frame_len;
+		const uint32_t n     = run < room ? run : room;
+
+		tcm_memcpy(&comms->frame_buffer[comms->frame_len], &data[i], n);
+		comms->frame_len += n;
+		comms->frame_overflow |= run > room;
+		i += run;
+
+		if (!delim) {
+			break;
+		}
+		i++;
+
+		// back to back delimiters carry no frame
+		if (comms->frame_len > 0 || comms->frame_overflow) {
+			comms_finish_frame(comms);
+		}
+	}
+}
+
+TCM_TEXT static void comms_consume(struct comms *comms, const uint8_t *data, uint32_t len)
+{
+	if (comms->framing == comms_framing_cobs) {
+		comms_consume_cobs(comms, data, len);
+	} else {
+		comms_consume_fixed(comms, data, len);
+	}
+}
+
+// the main loop is woken up only for what it has to handle
+TCM_TEXT static bool comms_isr_rx(void *ctx, const uint8_t *data, uint32_t len)
+{
+	struct comms  *comms   = ctx;
+	const uint32_t queued  = ring_buffer_get_data_len(&comms->packet_rb);
+	const uint64_t streams = comms->stats.stream_rx_cnt;
+
+	comms_consume(comms, data, len);
+
+	return ring_buffer_get_data_len(&comms->packet_rb) != queued ||
+	       comms->stats.stream_rx_cnt != streams;
+}
+
+bool comms_set_isr_mode(struct comms *comms, bool enable)
+{
+	if (!transport_set_rx_handler(comms->transport, enable ? comms_isr_rx : NULL, comms)) {
+		return false;
+	}
+	comms->isr_mode = enable;
+
+	return true;
+}
+
+void comms_update(struct comms *comms)
+{
+	uint8_t	 chunk[COMMS_RX_CHUNK_LEN];
+	uint32_t len = 0;
+
+	if (comms->isr_mode) {
+		return;
+	}
+
+	while ((len = transport_read(comms->transport, chunk, sizeof(chunk))) > 0) {
+		comms_consume(comms, chunk, len);
+	}
+}
+
+bool comms_packet_available(struct comms *comms)
+{
+	return !ring_buffer_empty(&comms->packet_rb) &&
+	       ring_buffer_get_data_len(&comms->packet_rb) >= sizeof(struct comms_packet);
+}
+
+// COBS encoded and delimited, in bus mode wrapped into {own address | reply, body, crc8}
+TCM_TEXT static uint32_t comms_build_frame(const struct comms *comms, const uint8_t *body,
+					   uint32_t len, uint8_t *frame)
+{
+	uint32_t frame_len = 0;
+
+	if (comms->address == COMMS_ADDR_NONE) {
+		frame_len = cobs_encode(body, len, frame);
+	} else {
+		uint8_t raw[COMMS_STREAM_FRAME_LEN + COMMS_BUS_OVERHEAD];
+
+		raw[0] = comms->address | COMMS_ADDR_REPLY;
+		tcm_memcpy(&raw[1], body, len);
+		raw[len + 1] = crc8(raw, len + 1);
+		frame_len    = cobs_encode(raw, len + COMMS_BUS_OVERHEAD, frame);
+	}
+	frame[frame_len++] = COBS_DELIMITER;
+
+	return frame_len;
+}
+
+TCM_TEXT void comms_send(struct comms *comms, struct comms_packet *packet)
+{
+	const enum comms_packet_type stat_type = (int)packet->type < (int)comms_packet_type_max
+						     ? packet->type
+						     : comms_packet_type_unknown;
+	uint8_t			     frame[TX_FRAME_LEN];
+	uint32_t		     frame_len = sizeof(struct comms_packet);
+
+	// in ISR mode acks and retx replies go out from the rx handler, it must not see
+	// last_write_packet half updated, only the frame is built under the lock, the
+	// transport queues it whole and waits for room with the rx handler running
+	transport_lock(comms->transport);
+	comms->stats.tx_packets_cnt[(int)stat_type]++;
+	if (comms->framing == comms_framing_cobs) {
+		frame_len = comms_build_frame(comms, (const uint8_t *)packet,
+					      sizeof(struct comms_packet), frame);
+	} else {
+		tcm_memcpy(frame, packet, sizeof(struct comms_packet));
+	}
+	if (packet != &comms->last_write_packet) {
+		tcm_memcpy(&comms->last_write_packet, packet, sizeof(struct comms_packet));
+	}
+	transport_unlock(comms->transport);
+
+	transport_write(comms->transport, frame, frame_len);
+}
+
+void comms_send_control_packet(struct comms *comms, enum comms_packet_type type)
+{
+	struct comms_packet packet = {0};
+	comms_create_control_packet(&packet, type);
+
+	comms_send(comms, &packet);
+}
+
+void comms_receive(struct comms *comms, struct comms_packet *packet)
+{
+	if (comms_packet_available(comms)) {
+		ring_buffer_read_many(&comms->packet_rb, (uint8_t *)packet,
+				      sizeof(struct comms_packet));
+	}
+}
+
+bool comms_stream_send(struct comms *comms, const uint8_t *payload, uint32_t length)
+{
+	uint8_t raw[COMMS_STREAM_FRAME_LEN];
+	uint8_t frame[TX_FRAME_LEN];
+
+	if (comms->framing != comms_framing_cobs || length > COMMS_STREAM_PAYLOAD_LEN) {
+		return false;
+	}
+
+	const uint32_t seq = comms->stream_seq;
+
+	raw[0] = length;
+	raw[1] = comms_packet_type_stream;
+	raw[2] = seq >> 0;
+	raw[3] = seq >> 8;
+	raw[4] = seq >> 16;
+	raw[5] = seq >> 24;
+	memcpy(&raw[COMMS_STREAM_HEADER_LEN], payload, length);
+
+	const uint32_t raw_len = COMMS_STREAM_HEADER_LEN + length;
+	raw[raw_len]	       = crc8(raw, raw_len);
+
+	const uint32_t frame_len = comms_build_frame(comms, raw, raw_len + 1, frame);
+
+	if (transport_writable(comms->transport) < frame_len) {
+		comms->stats.stream_full_cnt++;
+		return false;
+	}
+
+	transport_write(comms->transport, frame, frame_len);
+	comms->stream_seq++;
+	comms->stats.stream_tx_cnt++;
+
+	return true;
+}
@@ -0,0 +1,29 @@
+#include "core/crc32.h"
+
+// nibble table, 64 bytes of flash instead of 1K for a byte table
+static const uint32_t crc32_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+    0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++) {
+		crc ^= data[i];
+		crc = (crc >> 4) ^ crc32_table[crc & 0x0F];
+		crc = (crc >> 4) ^ crc32_table[crc & 0x0F];
+	}
+
+	return crc;
+}
+
+uint32_t crc32_final(uint32_t crc)
+{
+	return ~crc;
+}
+
+uint32_t crc32(const uint8_t *data, uint32_t length)
+{
+	return crc32_final(crc32_update(CRC32_INIT, data, length));
+}
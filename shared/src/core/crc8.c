@@ -1,6 +1,7 @@
 #include "core/crc8.h"
+#include "core/tcm.h"
 
-uint8_t crc8(uint8_t *data, uint32_t length)
+TCM_TEXT uint8_t crc8(uint8_t *data, uint32_t length)
 {
 	uint8_t crc = 0;
 
@@ -0,0 +1,87 @@
+#include "core/event-loop.h"
+#include "core/system.h"
+#include "core/tcm.h"
+#include <libopencm3/cm3/cortex.h>
+#include <stddef.h>
+
+struct event_subscriber {
+	uint32_t	events;
+	event_handler_t handler;
+	void	       *ctx;
+};
+
+TCM_BSS static volatile uint32_t s_pending;
+static struct timer_wheel     *s_timer_wheel;
+static struct event_subscriber s_subscribers[EVENT_LOOP_MAX_HANDLERS];
+static uint32_t		       s_subscribers_cnt;
+
+void event_loop_setup(struct timer_wheel *tw)
+{
+	s_timer_wheel	  = tw;
+	s_subscribers_cnt = 0;
+	s_pending	  = 0;
+}
+
+bool event_loop_subscribe(uint32_t events, event_handler_t handler, void *ctx)
+{
+	if (s_subscribers_cnt >= EVENT_LOOP_MAX_HANDLERS) {
+		return false;
+	}
+
+	s_subscribers[s_subscribers_cnt].events	 = events;
+	s_subscribers[s_subscribers_cnt].handler = handler;
+	s_subscribers[s_subscribers_cnt].ctx	 = ctx;
+	s_subscribers_cnt++;
+
+	return true;
+}
+
+TCM_TEXT void event_loop_post(uint32_t events)
+{
+	// ldrex/strex on Cortex-M7, no need to mask interrupts
+	__atomic_fetch_or(&s_pending, events, __ATOMIC_RELEASE);
+}
+
+static void schedule_wakeup(void)
+{
+	uint64_t deadline = 0;
+
+	if (s_timer_wheel && timer_wheel_next_deadline(s_timer_wheel, &deadline)) {
+		if (deadline <= system_get_ticks()) {
+			event_loop_post(EVENT_SYSTICK);
+		}
+		system_set_wakeup_tick(deadline);
+	} else {
+		system_clear_wakeup_tick();
+	}
+}
+
+static void sleep_until_event(void)
+{
+	// WFI still wakes on an interrupt that is pending while PRIMASK is set,
+	// so a post landing between the check and WFI can't be missed
+	cm_disable_interrupts();
+	if (s_pending == 0) {
+		system_idle();
+	}
+	cm_enable_interrupts();
+}
+
+void event_loop_run_once(void)
+{
+	const uint32_t events = __atomic_exchange_n(&s_pending, 0, __ATOMIC_ACQUIRE);
+
+	if (s_timer_wheel) {
+		timer_wheel_update(s_timer_wheel, system_get_ticks());
+	}
+
+	for (uint32_t i = 0; i < s_subscribers_cnt; ++i) {
+		if (events & s_subscribers[i].events) {
+			s_subscribers[i].handler(events & s_subscribers[i].events,
+						 s_subscribers[i].ctx);
+		}
+	}
+
+	schedule_wakeup();
+	sleep_until_event();
+}
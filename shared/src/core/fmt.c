@@ -0,0 +1,245 @@
+#include "core/fmt.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+enum fmt_length {
+	fmt_length_default,
+	fmt_length_hh,
+	fmt_length_h,
+	fmt_length_l,
+	fmt_length_ll,
+};
+
+struct fmt_spec {
+	bool		left_align;
+	bool		zero_pad;
+	uint32_t	width;
+	enum fmt_length length;
+};
+
+struct fmt_out {
+	fmt_putc_t putc;
+	void	  *ctx;
+	int	   count;
+};
+
+static void emit(struct fmt_out *out, char c)
+{
+	out->putc(out->ctx, c);
+	out->count++;
+}
+
+static void emit_repeat(struct fmt_out *out, char c, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		emit(out, c);
+	}
+}
+
+static void emit_string(struct fmt_out *out, const char *s, uint32_t len,
+			const struct fmt_spec *spec)
+{
+	const uint32_t padding = spec->width > len ? spec->width - len : 0;
+
+	if (!spec->left_align) {
+		emit_repeat(out, ' ', padding);
+	}
+	for (uint32_t i = 0; i < len; ++i) {
+		emit(out, s[i]);
+	}
+	if (spec->left_align) {
+		emit_repeat(out, ' ', padding);
+	}
+}
+
+// digits are produced in reverse order, returns how many were written
+static uint32_t format_digits(uint64_t value, uint32_t base, bool upper, char *buf)
+{
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	uint32_t    len	   = 0;
+
+	// keep 32-bit values on the cheap division path
+	if (value <= UINT32_MAX) {
+		uint32_t v = (uint32_t)value;
+		do {
+			buf[len++] = digits[v % base];
+			v /= base;
+		} while (v);
+	} else {
+		do {
+			buf[len++] = digits[value % base];
+			value /= base;
+		} while (value);
+	}
+
+	return len;
+}
+
+static void emit_number(struct fmt_out *out, uint64_t value, bool negative, uint32_t base,
+			bool upper, const struct fmt_spec *spec)
+{
+	char	       buf[20];
+	const uint32_t digits_len = format_digits(value, base, upper, buf);
+	const uint32_t len	  = digits_len + (negative ? 1 : 0);
+	const uint32_t padding	  = spec->width > len ? spec->width - len : 0;
+
+	if (!spec->left_align && !spec->zero_pad) {
+		emit_repeat(out, ' ', padding);
+	}
+	if (negative) {
+		emit(out, '-');
+	}
+	if (!spec->left_align && spec->zero_pad) {
+		emit_repeat(out, '0', padding);
+	}
+	for (uint32_t i = digits_len; i > 0; --i) {
+		emit(out, buf[i - 1]);
+	}
+	if (spec->left_align) {
+		emit_repeat(out, ' ', padding);
+	}
+}
+
+static uint64_t fetch_unsigned(va_list *args, enum fmt_length length)
+{
+	switch (length) {
+	case fmt_length_hh:
+		return (uint8_t)va_arg(*args, unsigned int);
+	case fmt_length_h:
+		return (uint16_t)va_arg(*args, unsigned int);
+	case fmt_length_l:
+		return va_arg(*args, unsigned long);
+	case fmt_length_ll:
+		return va_arg(*args, unsigned long long);
+	default:
+		return va_arg(*args, unsigned int);
+	}
+}
+
+static int64_t fetch_signed(va_list *args, enum fmt_length length)
+{
+	switch (length) {
+	case fmt_length_hh:
+		return (int8_t)va_arg(*args, int);
+	case fmt_length_h:
+		return (int16_t)va_arg(*args, int);
+	case fmt_length_l:
+		return va_arg(*args, long);
+	case fmt_length_ll:
+		return va_arg(*args, long long);
+	default:
+		return va_arg(*args, int);
+	}
+}
+
+static const char *parse_spec(const char *fmt, struct fmt_spec *spec)
+{
+	*spec = (struct fmt_spec){0};
+
+	for (;; ++fmt) {
+		if (*fmt == '-') {
+			spec->left_align = true;
+		} else if (*fmt == '0') {
+			spec->zero_pad = true;
+		} else {
+			break;
+		}
+	}
+
+	while (*fmt >= '0' && *fmt <= '9') {
+		spec->width = spec->width * 10 + (uint32_t)(*fmt - '0');
+		fmt++;
+	}
+
+	if (*fmt == 'h') {
+		fmt++;
+		spec->length = fmt_length_h;
+		if (*fmt == 'h') {
+			fmt++;
+			spec->length = fmt_length_hh;
+		}
+	} else if (*fmt == 'l') {
+		fmt++;
+		spec->length = fmt_length_l;
+		if (*fmt == 'l') {
+			fmt++;
+			spec->length = fmt_length_ll;
+		}
+	}
+
+	return fmt;
+}
+
+int fmt_vformat(fmt_putc_t putc, void *ctx, const char *fmt, va_list args)
+{
+	struct fmt_out out = {.putc = putc, .ctx = ctx, .count = 0};
+	va_list	       ap;
+
+	va_copy(ap, args);
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			emit(&out, *fmt++);
+			continue;
+		}
+
+		struct fmt_spec spec = {0};
+		fmt		     = parse_spec(fmt + 1, &spec);
+
+		switch (*fmt) {
+		case '%':
+			emit(&out, '%');
+			break;
+		case 'c': {
+			const char c = (char)va_arg(ap, int);
+			emit_string(&out, &c, 1, &spec);
+		} break;
+		case 's': {
+			const char *s	= va_arg(ap, const char *);
+			uint32_t    len = 0;
+			if (!s) {
+				s = "(null)";
+			}
+			while (s[len]) {
+				len++;
+			}
+			emit_string(&out, s, len, &spec);
+		} break;
+		case 'd':
+		case 'i': {
+			const int64_t  value = fetch_signed(&ap, spec.length);
+			const uint64_t magnitude =
+			    value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+			emit_number(&out, magnitude, value < 0, 10, false, &spec);
+		} break;
+		case 'u':
+			emit_number(&out, fetch_unsigned(&ap, spec.length), false, 10, false,
+				    &spec);
+			break;
+		case 'x':
+		case 'X':
+			emit_number(&out, fetch_unsigned(&ap, spec.length), false, 16, *fmt == 'X',
+				    &spec);
+			break;
+		case 'p': {
+			const uintptr_t ptr = (uintptr_t)va_arg(ap, void *);
+			emit(&out, '0');
+			emit(&out, 'x');
+			emit_number(&out, ptr, false, 16, false, &spec);
+		} break;
+		case '\0':
+			// dangling '%' at the end of the format string
+			va_end(ap);
+			return out.count;
+		default:
+			// unsupported conversion, print it verbatim so it's visible in logs
+			emit(&out, '%');
+			emit(&out, *fmt);
+			break;
+		}
+		fmt++;
+	}
+
+	va_end(ap);
+	return out.count;
+}
@@ -0,0 +1,43 @@
+#include "core/image-header.h"
+#include "core/crc32.h"
+#include "core/str.h"
+#include <stddef.h>
+
+enum image_status image_check(uint32_t address, uint32_t load_address, uint32_t max_size,
+			      const struct image_header **header)
+{
+	const uint8_t		  *image = (const uint8_t *)(uintptr_t)address;
+	const struct image_header *hdr =
+	    (const struct image_header *)&image[IMAGE_HEADER_OFFSET];
+	const uint32_t hdr_end = IMAGE_HEADER_OFFSET + sizeof(struct image_header);
+
+	*header = hdr;
+
+	if (hdr->magic != IMAGE_HEADER_MAGIC || hdr->header_version != IMAGE_HEADER_VERSION ||
+	    hdr->header_size != sizeof(struct image_header) ||
+	    hdr->header_crc32 !=
+		crc32((const uint8_t *)hdr, offsetof(struct image_header, header_crc32))) {
+		return image_status_no_header;
+	}
+
+	if (hdr->load_address != load_address || hdr->image_size < hdr_end ||
+	    hdr->image_size > max_size) {
+		return image_status_corrupt;
+	}
+
+	uint32_t crc = crc32_update(CRC32_INIT, image, IMAGE_HEADER_OFFSET);
+	crc	     = crc32_update(crc, &image[hdr_end], hdr->image_size - hdr_end);
+
+	return crc32_final(crc) == hdr->image_crc32 ? image_status_valid : image_status_corrupt;
+}
+
+const char *image_status_str(enum image_status status)
+{
+	switch (status) {
+		ENUM_CASE(image_status_no_header)
+		ENUM_CASE(image_status_valid)
+		ENUM_CASE(image_status_corrupt)
+	default:
+		return "image_status unknown";
+	}
+}
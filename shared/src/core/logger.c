@@ -1,4 +1,5 @@
 #include "core/logger.h"
+#include "core/fmt.h"
 #include "core/uart.h"
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scb.h>
@@ -42,10 +43,34 @@ static FILE uart_stream_cfg = {
 
 FILE *create_logger(void)
 {
-	uart_setup(&s_uart_logger_driver);
+	logger_setup();
 	return &uart_stream_cfg;
 }
 
+void logger_setup(void)
+{
+	uart_setup(&s_uart_logger_driver);
+}
+
+static void logger_putc(void *ctx, char c)
+{
+	struct uart_driver *drv = ctx;
+
+	uart_write_byte(drv, c);
+	if (c == '\n') {
+		uart_write_byte(drv, '\r');
+	}
+}
+
+void logger_printf(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fmt_vformat(logger_putc, &s_uart_logger_driver, fmt, args);
+	va_end(args);
+}
+
 void destroy_logger(void)
 {
 	uart_terminate(&s_uart_logger_driver);
@@ -0,0 +1,93 @@
+#include "core/loopback.h"
+#include <stddef.h>
+
+static uint32_t loopback_read_ifc(void *ctx, uint8_t *data, uint32_t length)
+{
+	struct loopback *lb = ctx;
+	return ring_buffer_read_up_to(&lb->in, data, length);
+}
+
+static void loopback_write_ifc(void *ctx, const uint8_t *data, uint32_t length)
+{
+	struct loopback *lb = ctx;
+
+	lb->written_cnt += length;
+	if (lb->out_size == 0) {
+		return;
+	}
+	if (!ring_buffer_write_many(&lb->out, data, length)) {
+		lb->dropped_cnt += length;
+	}
+}
+
+static uint32_t loopback_available_ifc(void *ctx)
+{
+	struct loopback *lb = ctx;
+	return ring_buffer_get_data_len(&lb->in);
+}
+
+static bool loopback_set_rx_handler_ifc(void *ctx, transport_rx_handler_t handler,
+				       void *handler_ctx)
+{
+	struct loopback *lb = ctx;
+	uint8_t		 chunk[32];
+	uint32_t	 len = 0;
+
+	while (handler && (len = ring_buffer_read_up_to(&lb->in, chunk, sizeof(chunk))) > 0) {
+		handler(handler_ctx, chunk, len);
+	}
+	lb->rx_handler = handler;
+	lb->rx_ctx     = handler_ctx;
+
+	return true;
+}
+
+static const struct transport_ops loopback_ops = {
+    .read	    = loopback_read_ifc,
+    .write	    = loopback_write_ifc,
+    .available	    = loopback_available_ifc,
+    .set_rx_handler = loopback_set_rx_handler_ifc,
+};
+
+void loopback_setup(struct loopback *lb, uint8_t *in_buffer, uint32_t in_size,
+		    uint8_t *out_buffer, uint32_t out_size)
+{
+	ring_buffer_setup(&lb->in, in_buffer, in_size);
+	lb->out_size = out_buffer ? out_size : 0;
+	if (lb->out_size) {
+		ring_buffer_setup(&lb->out, out_buffer, out_size);
+	}
+	lb->written_cnt	  = 0;
+	lb->dropped_cnt	  = 0;
+	lb->rx_handler	  = NULL;
+	lb->transport.ops = &loopback_ops;
+	lb->transport.ctx = lb;
+}
+
+struct transport *loopback_transport(struct loopback *lb)
+{
+	return &lb->transport;
+}
+
+uint32_t loopback_feed(struct loopback *lb, const uint8_t *data, uint32_t length)
+{
+	if (lb->rx_handler) {
+		lb->rx_handler(lb->rx_ctx, data, length);
+		return length;
+	}
+
+	const uint32_t space = ring_buffer_get_left_space_len(&lb->in);
+	const uint32_t len   = length < space ? length : space;
+
+	ring_buffer_write_many(&lb->in, data, len);
+	return len;
+}
+
+uint32_t loopback_drain(struct loopback *lb, uint8_t *data, uint32_t length)
+{
+	if (lb->out_size == 0) {
+		return 0;
+	}
+
+	return ring_buffer_read_up_to(&lb->out, data, length);
+}
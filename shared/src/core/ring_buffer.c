@@ -1,4 +1,6 @@
 #include "core/ring_buffer.h"
+#include "core/tcm.h"
+#include <string.h>
 
 void ring_buffer_setup(struct ring_buffer *rb, uint8_t *buffer, uint32_t size)
 {
@@ -13,24 +15,19 @@ bool ring_buffer_empty(struct ring_buffer *rb)
 	return rb->read_index == rb->write_index;
 }
 
-uint32_t ring_buffer_get_data_len(const struct ring_buffer *rb)
+TCM_TEXT uint32_t ring_buffer_get_data_len(const struct ring_buffer *rb)
 {
-	uint32_t total_size = rb->mask + 1;
-
-	if (rb->write_index >= rb->read_index) {
-		return rb->write_index - rb->read_index;
-	} else {
-		return total_size - (rb->read_index - rb->write_index);
-	}
+	// each index is read once, the other side may move its own index meanwhile
+	return (rb->write_index - rb->read_index) & rb->mask;
 }
 
-uint32_t ring_buffer_get_left_space_len(const struct ring_buffer *rb)
+TCM_TEXT uint32_t ring_buffer_get_left_space_len(const struct ring_buffer *rb)
 {
-	uint32_t total_size = rb->mask + 1;
-	return total_size - ring_buffer_get_data_len(rb);
+	// one slot always stays empty to tell a full buffer from an empty one
+	return rb->mask - ring_buffer_get_data_len(rb);
 }
 
-bool ring_buffer_write(struct ring_buffer *rb, uint8_t byte)
+TCM_TEXT bool ring_buffer_write(struct ring_buffer *rb, uint8_t byte)
 {
 	uint32_t local_read_index  = rb->read_index;
 	uint32_t local_write_index = rb->write_index;
@@ -47,7 +44,7 @@ bool ring_buffer_write(struct ring_buffer *rb, uint8_t byte)
 	return true;
 }
 
-bool ring_buffer_read(struct ring_buffer *rb, uint8_t *byte)
+TCM_TEXT bool ring_buffer_read(struct ring_buffer *rb, uint8_t *byte)
 {
 	uint32_t local_read_index  = rb->read_index;
 	uint32_t local_write_index = rb->write_index;
@@ -63,27 +60,47 @@ bool ring_buffer_read(struct ring_buffer *rb, uint8_t *byte)
 	return true;
 }
 
-bool ring_buffer_write_many(struct ring_buffer *rb, const uint8_t *data, uint32_t data_len)
+// bulk operations copy in at most two chunks (up to the end of the buffer and
+// from its start) and publish the index once, they never do partial transfers
+TCM_TEXT bool ring_buffer_write_many(struct ring_buffer *rb, const uint8_t *data, uint32_t data_len)
 {
-	for (uint32_t i = 0; i < data_len; ++i) {
-		if (ring_buffer_write(rb, data[i]) == false) {
-			return false;
-		}
+	if (data_len > ring_buffer_get_left_space_len(rb)) {
+		return false;
 	}
 
+	const uint32_t local_write_index = rb->write_index;
+	const uint32_t till_end		 = rb->mask + 1 - local_write_index;
+	const uint32_t first_len	 = data_len < till_end ? data_len : till_end;
+
+	tcm_memcpy(&rb->buffer[local_write_index], data, first_len);
+	tcm_memcpy(rb->buffer, &data[first_len], data_len - first_len);
+	rb->write_index = (local_write_index + data_len) & rb->mask;
+
 	return true;
 }
 
-bool ring_buffer_read_many(struct ring_buffer *rb, uint8_t *data, uint32_t data_len)
+uint32_t ring_buffer_read_up_to(struct ring_buffer *rb, uint8_t *data, uint32_t max_len)
 {
-	for (uint32_t i = 0; i < data_len; ++i) {
-		uint8_t tmp = 0;
+	const uint32_t available = ring_buffer_get_data_len(rb);
+	const uint32_t data_len	 = max_len < available ? max_len : available;
+
+	const uint32_t local_read_index = rb->read_index;
+	const uint32_t till_end		= rb->mask + 1 - local_read_index;
+	const uint32_t first_len	= data_len < till_end ? data_len : till_end;
 
-		if (ring_buffer_read(rb, &tmp) == false) {
-			return false;
-		}
-		data[i] = tmp;
+	memcpy(data, &rb->buffer[local_read_index], first_len);
+	memcpy(&data[first_len], rb->buffer, data_len - first_len);
+	rb->read_index = (local_read_index + data_len) & rb->mask;
+
+	return data_len;
+}
+
+bool ring_buffer_read_many(struct ring_buffer *rb, uint8_t *data, uint32_t data_len)
+{
+	if (data_len > ring_buffer_get_data_len(rb)) {
+		return false;
 	}
 
+	ring_buffer_read_up_to(rb, data, data_len);
 	return true;
 }
@@ -0,0 +1,61 @@
+#include "core/rtt.h"
+
+// RTO = SRTT + max(G, K * RTTVAR), the clock granularity G is one tick
+#define RTT_K 4
+
+static uint32_t clamp_rto(const struct rtt_estimator *rtt, uint32_t rto)
+{
+	if (rto < rtt->min_rto) {
+		return rtt->min_rto;
+	}
+
+	return rto > rtt->max_rto ? rtt->max_rto : rto;
+}
+
+void rtt_setup(struct rtt_estimator *rtt, uint32_t initial_rto, uint32_t min_rto,
+	       uint32_t max_rto)
+{
+	rtt->srtt_x8	= 0;
+	rtt->rttvar_x4	= 0;
+	rtt->min_rto	= min_rto;
+	rtt->max_rto	= max_rto;
+	rtt->rto	= clamp_rto(rtt, initial_rto);
+	rtt->sample_cnt = 0;
+}
+
+void rtt_sample(struct rtt_estimator *rtt, uint32_t rtt_ticks)
+{
+	if (rtt->sample_cnt == 0) {
+		// SRTT = R, RTTVAR = R / 2
+		rtt->srtt_x8   = rtt_ticks * 8;
+		rtt->rttvar_x4 = rtt_ticks * 2;
+	} else {
+		// RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, with the SRTT before this sample
+		// SRTT = 7/8 SRTT + 1/8 R
+		const int32_t err = (int32_t)(rtt->srtt_x8 >> 3) - (int32_t)rtt_ticks;
+
+		rtt->rttvar_x4 += (uint32_t)(err < 0 ? -err : err) - (rtt->rttvar_x4 >> 2);
+		rtt->srtt_x8 += rtt_ticks - (rtt->srtt_x8 >> 3);
+	}
+	rtt->sample_cnt++;
+
+	const uint32_t var_term = RTT_K * rtt->rttvar_x4 / 4;
+	const uint32_t rto	= (rtt->srtt_x8 >> 3) + (var_term < 1 ? 1 : var_term);
+
+	rtt->rto = clamp_rto(rtt, rto);
+}
+
+uint32_t rtt_rto(const struct rtt_estimator *rtt)
+{
+	return rtt->rto;
+}
+
+uint32_t rtt_srtt(const struct rtt_estimator *rtt)
+{
+	return rtt->srtt_x8 >> 3;
+}
+
+uint32_t rtt_rttvar(const struct rtt_estimator *rtt)
+{
+	return rtt->rttvar_x4 >> 2;
+}
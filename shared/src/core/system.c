@@ -1,24 +1,184 @@
 #include "core/system.h"
+#include "core/boot-handoff.h"
+#include "core/cache.h"
+#include "core/event-loop.h"
+#include "core/tcm.h"
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/memorymap.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/scb.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/stm32/rcc.h>
+#include <stdbool.h>
 
-volatile uint64_t ticks = 0;
+// Cortex-M7 keeps the DWT locked until the software lock is released
+#define DWT_LAR_REG (MMIO32(DWT_BASE + 0xFB0))
+#define DWT_LAR_KEY (0xC5ACCE55)
+
+#define CYCLES_PER_TICK (CPU_FREQ / SYSTICK_FREQ)
+// the reload register is 24 bits wide, ~77 ticks at CPU_FREQ
+#define IDLE_MAX_TICKS	(0x00FFFFFFU / CYCLES_PER_TICK)
+// closer than this to a tick boundary the counter is not touched
+#define IDLE_MIN_CYCLES CYCLES_PER_US
+
+TCM_BSS static volatile uint64_t ticks;
+
+// compared on the low word only, so thread mode updates it with a single store
+TCM_BSS static volatile uint32_t wakeup_tick;
+TCM_BSS static volatile bool	 wakeup_armed;
 
 // IRQ handler
-void sys_tick_handler(void)
+TCM_TEXT void sys_tick_handler(void)
 {
 	ticks++;
+
+	if (wakeup_armed && (int32_t)((uint32_t)ticks - wakeup_tick) >= 0) {
+		event_loop_post(EVENT_SYSTICK);
+	}
 }
 
 uint64_t system_get_ticks(void)
 {
-	return ticks;
+	// 64-bit load is done as two 32-bit loads, the IRQ may land in between.
+	// Every tick changes the low word, so two equal reads can't be torn.
+	uint64_t first	= 0;
+	uint64_t second = 0;
+
+	do {
+		first  = ticks;
+		second = ticks;
+	} while (first != second);
+
+	return first;
+}
+
+uint64_t system_get_us(void)
+{
+	uint64_t tick_count = 0;
+	uint32_t counter    = 0;
+	bool	 pending    = false;
+
+	// retry if the tick IRQ ran between reading ticks and the down-counter
+	do {
+		tick_count = system_get_ticks();
+		counter	   = systick_get_value();
+		pending	   = (SCB_ICSR & SCB_ICSR_PENDSTSET) != 0;
+	} while (tick_count != system_get_ticks());
+
+	// the counter wrapped but the IRQ did not run yet, from an ISR or with interrupts
+	// masked, the down-counter already belongs to the next tick
+	if (pending) {
+		counter = systick_get_value();
+		tick_count++;
+	}
+
+	const uint32_t elapsed_cycles = systick_get_reload() - counter;
+
+	return tick_count * (1000000 / SYSTICK_FREQ) + elapsed_cycles / CYCLES_PER_US;
+}
+
+uint32_t system_get_cycles(void)
+{
+	return dwt_read_cycle_counter();
+}
+
+void system_set_wakeup_tick(uint64_t tick)
+{
+	const uint64_t now = system_get_ticks();
+
+	if (tick > now + INT32_MAX) {
+		tick = now + INT32_MAX;
+	}
+
+	wakeup_armed = false;
+	wakeup_tick  = (uint32_t)tick;
+	wakeup_armed = true;
+}
+
+void system_clear_wakeup_tick(void)
+{
+	wakeup_armed = false;
+}
+
+static void wait_for_interrupt(void)
+{
+	__asm__ volatile("dsb\n\twfi" ::: "memory");
+}
+
+// cycles the counter ran since it was cleared with the given reload, at most one wrap
+static uint32_t systick_elapsed(uint32_t reload, bool wrapped)
+{
+	const uint32_t counter = systick_get_value();
+	uint32_t       elapsed = counter ? reload + 1 - counter : 0;
+
+	return wrapped ? elapsed + reload + 1 : elapsed;
 }
 
+void system_idle(void)
+{
+	const uint64_t now	  = system_get_ticks();
+	uint32_t       idle_ticks = IDLE_MAX_TICKS;
+
+	if (wakeup_armed) {
+		const int32_t until = (int32_t)(wakeup_tick - (uint32_t)now);
+
+		if (until < (int32_t)idle_ticks) {
+			idle_ticks = until > 0 ? (uint32_t)until : 0;
+		}
+	}
+
+	if (idle_ticks < 2) {
+		wait_for_interrupt();
+		return;
+	}
+
+	systick_counter_disable();
+	const uint32_t remaining = systick_get_value();
+
+	// the tick ended while masked, its IRQ has to run before the counter is stretched
+	if ((SCB_ICSR & SCB_ICSR_PENDSTSET) || remaining < IDLE_MIN_CYCLES) {
+		systick_counter_enable();
+		wait_for_interrupt();
+		return;
+	}
+
+	// one long period ending on the tick boundary idle_ticks away, the IRQ at its end
+	// counts the last tick and posts the wakeup as usual
+	const uint32_t reload = remaining + (idle_ticks - 1) * CYCLES_PER_TICK - 1;
+
+	systick_set_reload(reload);
+	systick_clear();
+	systick_counter_enable();
+	wait_for_interrupt();
+	systick_counter_disable();
+
+	const bool     wrapped = (SCB_ICSR & SCB_ICSR_PENDSTSET) != 0;
+	const uint32_t total   = CYCLES_PER_TICK - remaining + systick_elapsed(reload, wrapped);
+	uint32_t       whole   = total / CYCLES_PER_TICK;
+	uint32_t       left    = CYCLES_PER_TICK - total % CYCLES_PER_TICK;
+
+	if (left < IDLE_MIN_CYCLES) {
+		// counted a little early rather than lost
+		whole++;
+		left += CYCLES_PER_TICK;
+	}
+
+	// interrupts are masked, nothing else writes ticks until this returns
+	ticks += wrapped ? whole - 1 : whole;
+
+	// finish the tick in progress, the reload only takes effect on the next wrap, a
+	// few cycles are lost per idle period while the counter is stopped
+	systick_set_reload(left - 1);
+	systick_clear();
+	systick_counter_enable();
+	systick_set_reload(CYCLES_PER_TICK - 1);
+}
+
+static const struct rcc_clock_scale *const s_clock = &rcc_3v3[RCC_CLOCK_3V3_216MHZ];
+
 static void rcc_setup(void)
 {
-	rcc_clock_setup_hsi(&rcc_3v3[RCC_CLOCK_3V3_216MHZ]);
+	rcc_clock_setup_hsi(s_clock);
 }
 
 static void systic_setup(void)
@@ -28,10 +188,37 @@ static void systic_setup(void)
 	systick_interrupt_enable();
 }
 
+static void dwt_setup(void)
+{
+	DWT_LAR_REG = DWT_LAR_KEY;
+	dwt_enable_cycle_counter();
+}
+
 void system_setup(void)
 {
 	rcc_setup();
+	cache_enable();
+	systic_setup();
+	dwt_setup();
+}
+
+void system_resume(const struct boot_handoff *handoff)
+{
+	if (handoff->sysclk_hz != s_clock->ahb_frequency) {
+		system_setup();
+		return;
+	}
+
+	// PLL, flash latency and bus prescalers stay as the bootloader left them,
+	// only the frequencies libopencm3 derives peripheral timings from are restored
+	rcc_ahb_frequency  = s_clock->ahb_frequency;
+	rcc_apb1_frequency = s_clock->apb1_frequency;
+	rcc_apb2_frequency = s_clock->apb2_frequency;
+	ticks		   = handoff->handoff_ticks;
+
+	cache_enable();
 	systic_setup();
+	dwt_setup();
 }
 
 void system_terminate(void)
@@ -0,0 +1,30 @@
+#include "core/tcm.h"
+#include <stdint.h>
+
+// provided by the linker script
+extern uint32_t _itcm_text, _eitcm_text, _itcm_text_loadaddr;
+extern uint32_t _dtcm_data, _edtcm_data, _dtcm_data_loadaddr;
+extern uint32_t _dtcm_bss, _edtcm_bss;
+
+static void copy_words(uint32_t *dest, const uint32_t *end, const uint32_t *src)
+{
+	while (dest < end) {
+		*dest++ = *src++;
+	}
+}
+
+// libopencm3's reset handler only knows .data and .bss, the TCM sections are
+// loaded from the preinit array which runs after it and before main
+static void tcm_load(void)
+{
+	copy_words(&_itcm_text, &_eitcm_text, &_itcm_text_loadaddr);
+	copy_words(&_dtcm_data, &_edtcm_data, &_dtcm_data_loadaddr);
+
+	for (uint32_t *dest = &_dtcm_bss; dest < &_edtcm_bss; ++dest) {
+		*dest = 0;
+	}
+
+	__asm__ volatile("dsb\n\tisb" ::: "memory");
+}
+
+__attribute__((section(".preinit_array"), used)) static void (*const s_tcm_load)(void) = tcm_load;
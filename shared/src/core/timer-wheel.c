@@ -0,0 +1,233 @@
+#include "core/timer-wheel.h"
+#include <stddef.h>
+
+#define LEVEL_SHIFT(level) ((uint32_t)(level) * TIMER_WHEEL_SLOT_BITS)
+#define MAX_DELTA	   ((1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+#define EXPIRED_LEVEL	   (TIMER_WHEEL_LEVELS)
+
+static struct timer_wheel_timer **list_head(struct timer_wheel *tw, uint8_t level, uint8_t slot)
+{
+	if (level == EXPIRED_LEVEL) {
+		return &tw->expired;
+	}
+
+	return &tw->slots[level][slot];
+}
+
+static void list_unlink(struct timer_wheel *tw, struct timer_wheel_timer *t)
+{
+	struct timer_wheel_timer **head = list_head(tw, t->level, t->slot);
+
+	if (t->prev) {
+		t->prev->next = t->next;
+	} else {
+		*head = t->next;
+	}
+	if (t->next) {
+		t->next->prev = t->prev;
+	}
+
+	if (*head == NULL && t->level != EXPIRED_LEVEL) {
+		tw->occupied[t->level] &= ~(1ULL << t->slot);
+	}
+
+	t->next = NULL;
+	t->prev = NULL;
+}
+
+static void list_push(struct timer_wheel *tw, struct timer_wheel_timer *t, uint8_t level,
+		      uint8_t slot)
+{
+	struct timer_wheel_timer **head = list_head(tw, level, slot);
+
+	t->level = level;
+	t->slot	 = slot;
+	t->prev	 = NULL;
+	t->next	 = *head;
+	if (*head) {
+		(*head)->prev = t;
+	}
+	*head = t;
+
+	if (level != EXPIRED_LEVEL) {
+		tw->occupied[level] |= (1ULL << slot);
+	}
+}
+
+static void slot_insert(struct timer_wheel *tw, struct timer_wheel_timer *t)
+{
+	uint64_t expires = t->expires < tw->next_tick ? tw->next_tick : t->expires;
+	uint64_t delta	 = expires - tw->next_tick;
+
+	if (delta > MAX_DELTA) {
+		// parked in the last level, re-cascaded with the real expiry later
+		delta	= MAX_DELTA;
+		expires = tw->next_tick + MAX_DELTA;
+	}
+
+	uint8_t level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << LEVEL_SHIFT(level + 1))) {
+		level++;
+	}
+
+	const uint8_t slot = (expires >> LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOTS_MASK;
+	list_push(tw, t, level, slot);
+}
+
+// offset of the first set bit at or after start, going around, -1 if none
+static int first_set_from(uint64_t bitmap, uint32_t start)
+{
+	if (bitmap == 0) {
+		return -1;
+	}
+
+	const uint64_t rotated =
+	    start == 0 ? bitmap : (bitmap >> start) | (bitmap << (TIMER_WHEEL_SLOTS - start));
+
+	return __builtin_ctzll(rotated);
+}
+
+static void cascade(struct timer_wheel *tw, uint8_t level, uint8_t slot)
+{
+	struct timer_wheel_timer *list = tw->slots[level][slot];
+
+	tw->slots[level][slot] = NULL;
+	tw->occupied[level] &= ~(1ULL << slot);
+
+	while (list) {
+		struct timer_wheel_timer *t = list;
+		list			    = t->next;
+		slot_insert(tw, t);
+	}
+}
+
+static void process_tick(struct timer_wheel *tw)
+{
+	const uint64_t tick = tw->next_tick;
+
+	for (uint8_t level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+		if ((tick & ((1ULL << LEVEL_SHIFT(level)) - 1)) != 0) {
+			break;
+		}
+		cascade(tw, level, (tick >> LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOTS_MASK);
+	}
+
+	const uint8_t slot = tick & TIMER_WHEEL_SLOTS_MASK;
+	while (tw->slots[0][slot]) {
+		struct timer_wheel_timer *t = tw->slots[0][slot];
+		list_unlink(tw, t);
+		list_push(tw, t, EXPIRED_LEVEL, 0);
+	}
+
+	// callbacks may arm timers, those must land after the tick being dispatched
+	tw->next_tick = tick + 1;
+
+	while (tw->expired) {
+		struct timer_wheel_timer *t = tw->expired;
+		list_unlink(tw, t);
+		t->armed = false;
+		tw->armed_cnt--;
+
+		if (t->period) {
+			t->expires += t->period;
+			t->armed = true;
+			tw->armed_cnt++;
+			slot_insert(tw, t);
+		}
+
+		if (t->callback) {
+			t->callback(t, t->ctx);
+		}
+	}
+}
+
+void timer_wheel_setup(struct timer_wheel *tw, uint64_t now)
+{
+	*tw	      = (struct timer_wheel){0};
+	tw->next_tick = now + 1;
+}
+
+void timer_wheel_timer_setup(struct timer_wheel_timer *t, timer_wheel_callback_t callback,
+			     void *ctx)
+{
+	*t	    = (struct timer_wheel_timer){0};
+	t->callback = callback;
+	t->ctx	    = ctx;
+}
+
+void timer_wheel_arm(struct timer_wheel *tw, struct timer_wheel_timer *t, uint64_t delay,
+		     uint64_t period)
+{
+	timer_wheel_cancel(tw, t);
+
+	t->expires = tw->next_tick - 1 + delay;
+	t->period  = period;
+	t->armed   = true;
+	tw->armed_cnt++;
+	slot_insert(tw, t);
+}
+
+void timer_wheel_cancel(struct timer_wheel *tw, struct timer_wheel_timer *t)
+{
+	if (!t->armed) {
+		return;
+	}
+
+	list_unlink(tw, t);
+	t->armed = false;
+	tw->armed_cnt--;
+}
+
+bool timer_wheel_is_armed(const struct timer_wheel_timer *t)
+{
+	return t->armed;
+}
+
+bool timer_wheel_next_deadline(const struct timer_wheel *tw, uint64_t *deadline)
+{
+	if (tw->armed_cnt == 0) {
+		return false;
+	}
+
+	bool	 found	  = false;
+	uint64_t earliest = 0;
+
+	for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+		const uint32_t shift = LEVEL_SHIFT(level);
+		// first block boundary at or after next_tick, slots of this level cascade there
+		const uint64_t block = (tw->next_tick + (1ULL << shift) - 1) >> shift;
+		const int      off   = first_set_from(tw->occupied[level],
+						      (uint32_t)(block & TIMER_WHEEL_SLOTS_MASK));
+		if (off < 0) {
+			continue;
+		}
+
+		const uint64_t candidate = (block + (uint64_t)off) << shift;
+		if (!found || candidate < earliest) {
+			earliest = candidate;
+			found	 = true;
+		}
+	}
+
+	if (found) {
+		*deadline = earliest;
+	}
+
+	return found;
+}
+
+void timer_wheel_update(struct timer_wheel *tw, uint64_t now)
+{
+	while (tw->next_tick <= now) {
+		uint64_t deadline = 0;
+
+		if (!timer_wheel_next_deadline(tw, &deadline) || deadline > now) {
+			tw->next_tick = now + 1;
+			break;
+		}
+
+		// nothing can be due before the deadline, skip the empty ticks
+		tw->next_tick = deadline;
+		process_tick(tw);
+	}
+}
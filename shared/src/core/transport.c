@@ -0,0 +1,50 @@
+#include "core/transport.h"
+#include "core/tcm.h"
+#include <stddef.h>
+
+uint32_t transport_read(struct transport *t, uint8_t *data, uint32_t length)
+{
+	return t->ops->read(t->ctx, data, length);
+}
+
+TCM_TEXT void transport_write(struct transport *t, const uint8_t *data, uint32_t length)
+{
+	t->ops->write(t->ctx, data, length);
+}
+
+uint32_t transport_available(struct transport *t)
+{
+	return t->ops->available(t->ctx);
+}
+
+uint32_t transport_writable(struct transport *t)
+{
+	if (t->ops->writable == NULL) {
+		return UINT32_MAX;
+	}
+
+	return t->ops->writable(t->ctx);
+}
+
+bool transport_set_rx_handler(struct transport *t, transport_rx_handler_t handler, void *ctx)
+{
+	if (t->ops->set_rx_handler == NULL) {
+		return false;
+	}
+
+	return t->ops->set_rx_handler(t->ctx, handler, ctx);
+}
+
+TCM_TEXT void transport_lock(struct transport *t)
+{
+	if (t->ops->lock) {
+		t->ops->lock(t->ctx);
+	}
+}
+
+TCM_TEXT void transport_unlock(struct transport *t)
+{
+	if (t->ops->unlock) {
+		t->ops->unlock(t->ctx);
+	}
+}
@@ -0,0 +1,124 @@
+#include "core/uart-dma-tx.h"
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/usart.h>
+#include <string.h>
+
+// called with the DMA IRQ masked or from it
+static void uart_dma_tx_kick(struct uart_dma_tx *tx)
+{
+	if (tx->busy || tx->fill_len == 0) {
+		return;
+	}
+
+	uint8_t *buffer = tx->buffer[tx->fill];
+	cache_clean_dcache(buffer, tx->fill_len);
+
+	dma_clear_interrupt_flags(tx->dma, tx->stream, DMA_TCIF | DMA_TEIF);
+	dma_set_memory_address(tx->dma, tx->stream, (uint32_t)(uintptr_t)buffer);
+	dma_set_number_of_data(tx->dma, tx->stream, tx->fill_len);
+	dma_enable_stream(tx->dma, tx->stream);
+
+	tx->sent_cnt += tx->fill_len;
+	tx->busy     = true;
+	tx->fill ^= 1;
+	tx->fill_len = 0;
+}
+
+void uart_dma_tx_setup(struct uart_dma_tx *tx)
+{
+	tx->fill_len	= 0;
+	tx->fill	= 0;
+	tx->busy	= false;
+	tx->sent_cnt	= 0;
+	tx->dropped_cnt = 0;
+
+	dma_stream_reset(tx->dma, tx->stream);
+	dma_channel_select(tx->dma, tx->stream, tx->channel);
+	dma_set_transfer_mode(tx->dma, tx->stream, DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+	dma_set_priority(tx->dma, tx->stream, DMA_SxCR_PL_LOW);
+	dma_set_memory_size(tx->dma, tx->stream, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(tx->dma, tx->stream, DMA_SxCR_PSIZE_8BIT);
+	dma_enable_memory_increment_mode(tx->dma, tx->stream);
+	dma_set_peripheral_address(tx->dma, tx->stream,
+				   (uint32_t)(uintptr_t)&USART_TDR(tx->uart->usart_dev));
+	dma_enable_transfer_complete_interrupt(tx->dma, tx->stream);
+
+	usart_enable_tx_dma(tx->uart->usart_dev);
+	nvic_enable_irq(tx->nvic_irq);
+}
+
+bool uart_dma_tx_write(struct uart_dma_tx *tx, const uint8_t *data, uint32_t length)
+{
+	bool written = false;
+
+	nvic_disable_irq(tx->nvic_irq);
+
+	if (tx->fill_len + length <= UART_DMA_TX_BUFFER_LEN) {
+		memcpy(&tx->buffer[tx->fill][tx->fill_len], data, length);
+		tx->fill_len += length;
+		written = true;
+	} else {
+		tx->dropped_cnt += length;
+	}
+	uart_dma_tx_kick(tx);
+
+	nvic_enable_irq(tx->nvic_irq);
+
+	return written;
+}
+
+uint32_t uart_dma_tx_writable(struct uart_dma_tx *tx)
+{
+	// a snapshot, the ISR only ever makes more room
+	return UART_DMA_TX_BUFFER_LEN - tx->fill_len;
+}
+
+void uart_dma_tx_handle_irq(struct uart_dma_tx *tx)
+{
+	if (!dma_get_interrupt_flag(tx->dma, tx->stream, DMA_TCIF)) {
+		return;
+	}
+	dma_clear_interrupt_flags(tx->dma, tx->stream, DMA_TCIF);
+
+	tx->busy = false;
+	// whatever queued up meanwhile goes out back to back
+	uart_dma_tx_kick(tx);
+}
+
+static uint32_t uart_dma_tx_read_ifc(void *ctx, uint8_t *data, uint32_t length)
+{
+	struct uart_dma_tx *tx = ctx;
+	return uart_read(tx->uart, data, length);
+}
+
+static void uart_dma_tx_write_ifc(void *ctx, const uint8_t *data, uint32_t length)
+{
+	uart_dma_tx_write(ctx, data, length);
+}
+
+static uint32_t uart_dma_tx_available_ifc(void *ctx)
+{
+	struct uart_dma_tx *tx = ctx;
+	return ring_buffer_get_data_len(&tx->uart->rb);
+}
+
+static uint32_t uart_dma_tx_writable_ifc(void *ctx)
+{
+	return uart_dma_tx_writable(ctx);
+}
+
+static const struct transport_ops uart_dma_tx_ops = {
+    .read      = uart_dma_tx_read_ifc,
+    .write     = uart_dma_tx_write_ifc,
+    .available = uart_dma_tx_available_ifc,
+    .writable  = uart_dma_tx_writable_ifc,
+};
+
+struct transport *uart_dma_tx_transport(struct uart_dma_tx *tx)
+{
+	tx->transport.ops = &uart_dma_tx_ops;
+	tx->transport.ctx = tx;
+
+	return &tx->transport;
+}
@@ -1,33 +1,181 @@
 #include "core/uart.h"
+#include "core/event-loop.h"
 #include "core/ring_buffer.h"
+#include "core/tcm.h"
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/usart.h>
 #include <stddef.h>
 
-void uart_handle_irq(struct uart_driver *drv)
+#define UART_RX_ERRORS (USART_ISR_ORE | USART_ISR_FE | USART_ISR_NF | USART_ISR_PE)
+
+// the TCM_TEXT functions touch the registers directly, the libopencm3 helpers run from flash
+
+// RTS is active low, stopped from the ISR
+TCM_TEXT static void uart_rts_stop(struct uart_driver *drv)
 {
-	const bool overrun_occurred = usart_get_flag(drv->usart_dev, USART_FLAG_ORE) == 1;
-	const bool received_data    = usart_get_flag(drv->usart_dev, USART_FLAG_RXNE) == 1;
+	GPIO_BSRR(drv->gpio_port) = drv->rts_pin;
+}
+
+static void uart_rts_resume(struct uart_driver *drv)
+{
+	gpio_clear(drv->gpio_port, drv->rts_pin);
+}
+
+// holds the ISR off, it shares the TX queue and whatever the rx handler touches
+TCM_TEXT static void uart_lock(struct uart_driver *drv)
+{
+	if (drv->lock_depth++ == 0) {
+		NVIC_ICER(drv->nvic_irq / 32) = 1U << (drv->nvic_irq % 32);
+		// the write to NVIC_ICER must take effect before the guarded accesses
+		__asm__ volatile("dsb\n\tisb" ::: "memory");
+	}
+}
+
+TCM_TEXT static void uart_unlock(struct uart_driver *drv)
+{
+	if (--drv->lock_depth == 0) {
+		NVIC_ISER(drv->nvic_irq / 32) = 1U << (drv->nvic_irq % 32);
+	}
+}
+
+// called with the IRQ held off or from it, TXE must be set
+TCM_TEXT static void uart_tx_next(struct uart_driver *drv)
+{
+	uint8_t byte = 0;
+
+	if (ring_buffer_read(&drv->tx_rb, &byte)) {
+		USART_TDR(drv->usart_dev) = byte;
+	} else {
+		USART_CR1(drv->usart_dev) &= ~USART_CR1_TXEIE;
+		drv->tx_active = false;
+	}
+}
+
+// in an ISR or under uart_lock the TXE interrupt cannot run, only polling drains the queue
+TCM_TEXT static bool uart_irq_held(const struct uart_driver *drv)
+{
+	uint32_t ipsr = 0;
+
+	__asm__ volatile("mrs %0, ipsr" : "=r"(ipsr));
+
+	return drv->lock_depth > 0 || ipsr != 0;
+}
 
-	if (received_data || overrun_occurred) {
-		if (ring_buffer_write(&drv->rb, usart_recv(drv->usart_dev))) {
-			// handle buffer overflow
+// a frame is queued whole, writes from the ISR cannot land in the middle of it, the wait
+// for room runs with the IRQ enabled so RX keeps being served meanwhile
+TCM_TEXT static void uart_queue(struct uart_driver *drv, const uint8_t *data, uint32_t length)
+{
+	const uint32_t capacity = sizeof(drv->tx_rb_buffer) - 1;
+
+	while (length > 0) {
+		// writes longer than the whole queue go in pieces
+		const uint32_t chunk = length < capacity ? length : capacity;
+
+		while (ring_buffer_get_left_space_len(&drv->tx_rb) < chunk) {
+			if (uart_irq_held(drv) && (USART_ISR(drv->usart_dev) & USART_ISR_TXE)) {
+				uart_tx_next(drv);
+			}
+		}
+
+		uart_lock(drv);
+		// an ack from the rx handler may have taken the room in between
+		if (ring_buffer_get_left_space_len(&drv->tx_rb) < chunk) {
+			uart_unlock(drv);
+			continue;
+		}
+		for (uint32_t i = 0; i < chunk; ++i) {
+			ring_buffer_write(&drv->tx_rb, data[i]);
+		}
+		if (!drv->tx_active) {
+			drv->tx_active = true;
+			USART_CR1(drv->usart_dev) |= USART_CR1_TXEIE;
+		}
+		uart_unlock(drv);
+
+		data += chunk;
+		length -= chunk;
+	}
+}
+
+TCM_TEXT void uart_handle_irq(struct uart_driver *drv)
+{
+	const uint32_t isr    = USART_ISR(drv->usart_dev);
+	const uint32_t errors = isr & UART_RX_ERRORS;
+
+	if (errors) {
+		drv->stats.overrun_cnt += (isr & USART_ISR_ORE) ? 1 : 0;
+		drv->stats.framing_err_cnt += (isr & USART_ISR_FE) ? 1 : 0;
+		drv->stats.noise_cnt += (isr & USART_ISR_NF) ? 1 : 0;
+		drv->stats.parity_err_cnt += (isr & USART_ISR_PE) ? 1 : 0;
+		// ICR bits match the ISR ones, a pending ORE would otherwise retrigger the IRQ
+		USART_ICR(drv->usart_dev) = errors;
+	}
+
+	if (drv->tx_active && (isr & USART_ISR_TXE)) {
+		uart_tx_next(drv);
+	}
+
+	if ((isr & USART_ISR_RXNE) == 0) {
+		return;
+	}
+
+	const uint8_t byte = USART_RDR(drv->usart_dev);
+
+	if (drv->rx_handler) {
+		// the main loop only hears of what the handler completed
+		if (drv->rx_handler(drv->rx_ctx, &byte, 1)) {
+			event_loop_post(EVENT_UART_RX);
 		}
+		return;
+	}
+
+	if (!ring_buffer_write(&drv->rb, byte)) {
+		drv->stats.rb_overflow_cnt++;
+	}
+
+	if (drv->rts_pin && !drv->rts_throttled &&
+	    ring_buffer_get_data_len(&drv->rb) >= drv->rts_high_watermark) {
+		uart_rts_stop(drv);
+		drv->rts_throttled = true;
+		drv->stats.rts_throttle_cnt++;
 	}
+
+	event_loop_post(EVENT_UART_RX);
 }
 
 void uart_setup(struct uart_driver *drv)
 {
 	ring_buffer_setup(&drv->rb, drv->rb_buffer, sizeof(drv->rb_buffer));
+	ring_buffer_setup(&drv->tx_rb, drv->tx_rb_buffer, sizeof(drv->tx_rb_buffer));
+	drv->stats	= (struct uart_stats){0};
+	drv->rx_handler = NULL;
+	drv->lock_depth = 0;
+	drv->tx_active	= false;
+
+	if (drv->rts_high_watermark == 0) {
+		drv->rts_high_watermark = sizeof(drv->rb_buffer) * 3 / 4;
+	}
+	if (drv->rts_low_watermark == 0) {
+		drv->rts_low_watermark = sizeof(drv->rb_buffer) / 4;
+	}
 
 	rcc_periph_clock_enable(drv->gpio_port_clk);
-	gpio_mode_setup(drv->gpio_port, GPIO_MODE_AF, GPIO_PUPD_NONE, drv->gpio_pins);
-	gpio_set_af(drv->gpio_port, drv->gpio_af, drv->gpio_pins);
+	gpio_mode_setup(drv->gpio_port, GPIO_MODE_AF, GPIO_PUPD_NONE,
+			drv->gpio_pins | drv->cts_pin);
+	gpio_set_af(drv->gpio_port, drv->gpio_af, drv->gpio_pins | drv->cts_pin);
+
+	if (drv->rts_pin) {
+		// the peer waits until the receiver is enabled
+		uart_rts_stop(drv);
+		drv->rts_throttled = true;
+		gpio_mode_setup(drv->gpio_port, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, drv->rts_pin);
+	}
 
 	rcc_periph_clock_enable(drv->usart_clock_dev);
 	usart_set_mode(drv->usart_dev, drv->mode);
-	usart_set_flow_control(drv->usart_dev, USART_FLOWCONTROL_NONE);
+	usart_set_flow_control(drv->usart_dev,
+			       drv->cts_pin ? USART_FLOWCONTROL_CTS : USART_FLOWCONTROL_NONE);
 	usart_set_databits(drv->usart_dev, 8);
 	usart_set_baudrate(drv->usart_dev, drv->baud_rate);
 	usart_set_parity(drv->usart_dev, 0);
@@ -36,29 +184,43 @@ void uart_setup(struct uart_driver *drv)
 	if ((drv->mode & USART_MODE_RX) == USART_MODE_RX) {
 
 		usart_enable_rx_interrupt(drv->usart_dev);
+	}
+	if ((drv->mode & USART_MODE_RX) == USART_MODE_RX || drv->tx_irq) {
 		nvic_enable_irq(drv->nvic_irq);
 	}
 
 	usart_enable(drv->usart_dev);
+
+	if (drv->rts_pin) {
+		uart_rts_resume(drv);
+		drv->rts_throttled = false;
+	}
 }
 
 void uart_terminate(struct uart_driver *drv)
 {
+	uart_flush(drv);
 	usart_disable(drv->usart_dev);
 
 	if ((drv->mode & USART_MODE_RX) == USART_MODE_RX) {
 
 		usart_disable_rx_interrupt(drv->usart_dev);
-		nvic_disable_irq(drv->nvic_irq);
 	}
+	nvic_disable_irq(drv->nvic_irq);
 	
 	rcc_periph_clock_disable(drv->usart_clock_dev);
-	gpio_mode_setup(drv->gpio_port, GPIO_MODE_ANALOG, GPIO_PUPD_NONE, drv->gpio_pins);
+	gpio_mode_setup(drv->gpio_port, GPIO_MODE_ANALOG, GPIO_PUPD_NONE,
+			drv->gpio_pins | drv->cts_pin | drv->rts_pin);
 	rcc_periph_clock_disable(drv->gpio_port_clk);
 }
 
-void uart_write(struct uart_driver *drv, uint8_t *data, const uint32_t length)
+TCM_TEXT void uart_write(struct uart_driver *drv, const uint8_t *data, const uint32_t length)
 {
+	if (drv->tx_irq) {
+		uart_queue(drv, data, length);
+		return;
+	}
+
 	for (size_t i = 0; i < length; ++i) {
 		uart_write_byte(drv, data[i]);
 	}
@@ -66,22 +228,33 @@ void uart_write(struct uart_driver *drv, uint8_t *data, const uint32_t length)
 
 void uart_write_byte(struct uart_driver *drv, uint8_t data)
 {
+	if (drv->tx_irq) {
+		uart_queue(drv, &data, 1);
+		return;
+	}
+
 	usart_send_blocking(drv->usart_dev, (uint16_t)data);
 }
 
-uint32_t uart_read(struct uart_driver *drv, uint8_t *data, const uint32_t length)
+void uart_flush(struct uart_driver *drv)
 {
-	if (length == 0) {
-		return 0;
+	while (drv->tx_active) {
+	}
+	while (!usart_get_flag(drv->usart_dev, USART_FLAG_TC)) {
 	}
+}
 
-	for (size_t i = 0; i < length; ++i) {
-		if (!ring_buffer_read(&drv->rb, &data[i])) {
-			return i;
-		}
+uint32_t uart_read(struct uart_driver *drv, uint8_t *data, const uint32_t length)
+{
+	const uint32_t read = ring_buffer_read_up_to(&drv->rb, data, length);
+
+	// racing the ISR is harmless, it re-checks the fill on every received byte
+	if (drv->rts_throttled && ring_buffer_get_data_len(&drv->rb) <= drv->rts_low_watermark) {
+		drv->rts_throttled = false;
+		uart_rts_resume(drv);
 	}
 
-	return length;
+	return read;
 }
 
 uint8_t uart_read_byte(struct uart_driver *drv)
@@ -96,3 +269,69 @@ bool uart_data_available(struct uart_driver *drv)
 {
 	return !ring_buffer_empty(&drv->rb);
 }
+
+static uint32_t uart_transport_read(void *ctx, uint8_t *data, uint32_t length)
+{
+	return uart_read(ctx, data, length);
+}
+
+TCM_TEXT static void uart_transport_write(void *ctx, const uint8_t *data, uint32_t length)
+{
+	uart_write(ctx, data, length);
+}
+
+static uint32_t uart_transport_available(void *ctx)
+{
+	struct uart_driver *drv = ctx;
+	return ring_buffer_get_data_len(&drv->rb);
+}
+
+static bool uart_transport_set_rx_handler(void *ctx, transport_rx_handler_t handler,
+					  void *handler_ctx)
+{
+	struct uart_driver *drv = ctx;
+	uint8_t		    chunk[32];
+	uint32_t	    len = 0;
+
+	// a reply from the handler would land in the middle of a blocking write, only the TX
+	// queue takes whole frames from either side
+	if (handler && !drv->tx_irq) {
+		return false;
+	}
+
+	uart_lock(drv);
+	// what arrived before belongs to the handler as well, in order
+	while (handler && (len = uart_read(drv, chunk, sizeof(chunk))) > 0) {
+		handler(handler_ctx, chunk, len);
+	}
+	drv->rx_handler = handler;
+	drv->rx_ctx	= handler_ctx;
+	uart_unlock(drv);
+
+	return true;
+}
+
+TCM_TEXT static void uart_transport_lock(void *ctx)
+{
+	uart_lock(ctx);
+}
+
+TCM_TEXT static void uart_transport_unlock(void *ctx)
+{
+	uart_unlock(ctx);
+}
+
+static const struct transport_ops uart_transport_ops = {
+    .read	    = uart_transport_read,
+    .write	    = uart_transport_write,
+    .available	    = uart_transport_available,
+    .set_rx_handler = uart_transport_set_rx_handler,
+    .lock	    = uart_transport_lock,
+    .unlock	    = uart_transport_unlock,
+};
+
+void uart_transport_setup(struct transport *t, struct uart_driver *drv)
+{
+	t->ops = &uart_transport_ops;
+	t->ctx = drv;
+}